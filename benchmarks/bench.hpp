@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <utility>
+
+/* A minimal timing harness, so that the benchmarks don't depend on any
+ * external library */
+namespace bench {
+#if defined(_MSC_VER) && !defined(__clang__)
+	/* Forces the compiler to assume x is read and modified, so that the
+	 * computations leading to it are not optimized away */
+	template <class T>
+	inline void do_not_optimize(T &x) {
+		static const void *volatile sink;
+		sink = &x;
+		_ReadWriteBarrier();
+	}
+#else
+	/* Forces the compiler to assume x is read and modified, so that the
+	 * computations leading to it are not optimized away */
+	template <class T>
+	inline void do_not_optimize(T &x) {
+		asm volatile("" : : "g"(&x) : "memory");
+	}
+#endif
+
+	struct options {
+		// The minimum duration of a measured run, in seconds
+		double min_time = 0.01;
+		// The number of measured runs, of which the fastest is kept
+		int repeats = 5;
+	};
+
+	/**
+	 * Measures the time per iteration of f, which must be callable as f(n)
+	 * and run n iterations of the measured operation. The number of
+	 * iterations is doubled until a run lasts at least opt.min_time, then
+	 * the fastest of opt.repeats runs is kept
+	 * @return The duration of one iteration, in nanoseconds
+	 */
+	template <class F>
+	double measure(F &&f, const options &opt = {}) {
+		using clock = std::chrono::steady_clock;
+		using ns = std::chrono::duration<double, std::nano>;
+		size_t n = 1 << 8;
+		for (;;) {
+			auto start = clock::now();
+			f(n);
+			ns d = clock::now() - start;
+			if (d.count() >= opt.min_time * 1e9) break;
+			n *= 2;
+		}
+		double best = 0;
+		for (int i = 0; i < opt.repeats; ++i) {
+			auto start = clock::now();
+			f(n);
+			ns d = clock::now() - start;
+			if (!i || d.count() < best) best = d.count();
+		}
+		return best / n;
+	}
+
+	/* Prints a table row: a label followed by one cell per column, a
+	 * negative value standing for a missing measurement */
+	inline void print_row(const char *label, const double *values,
+						  size_t count) {
+		std::printf("%-12s", label);
+		for (size_t i = 0; i < count; ++i) {
+			if (values[i] < 0) std::printf("%16s", "-");
+			else std::printf("%13.2f ns", values[i]);
+		}
+		std::printf("\n");
+	}
+	inline void print_header(const char *title, const char *const *columns,
+							 size_t count) {
+		std::printf("\n%-12s", title);
+		for (size_t i = 0; i < count; ++i)
+			std::printf("%16s", columns[i]);
+		std::printf("\n");
+	}
+} // namespace bench
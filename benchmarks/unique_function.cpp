@@ -0,0 +1,143 @@
+#include <libstra/unique_function.hpp>
+#include "bench.hpp"
+#include <cstdio>
+#include <functional>
+#include <queue>
+
+static constexpr size_t N = 1 << 20;
+
+static volatile size_t sink = 0;
+
+/* A callable object with a capture of Size bytes */
+template <size_t Size>
+struct payload {
+	unsigned char data[Size];
+	int operator()(int x) const { return x + data[0]; }
+};
+template <>
+struct payload<0> {
+	int operator()(int x) const { return x + 1; }
+};
+
+static int raw_function(int x) {
+	return x + 1;
+}
+
+enum impl { fn_ptr, fn_ref, unique_fn, std_fn, impl_count };
+static const char *const impl_names[] = {
+	"function ptr",
+	"function_ref",
+	"unique_function",
+	"std::function",
+};
+
+// Construction from the callable object, followed by the destruction
+template <class Function, size_t Size>
+double construct_destroy() {
+	return bench::measure([](size_t n) {
+		payload<Size> p{};
+		for (size_t i = 0; i < n; ++i) {
+			bench::do_not_optimize(p);
+			Function f(p);
+			bench::do_not_optimize(f);
+		}
+	});
+}
+
+// One move construction and one move assignment
+template <class Function, size_t Size>
+double move() {
+	return bench::measure([](size_t n) {
+		Function a(payload<Size>{});
+		for (size_t i = 0; i < n; ++i) {
+			Function b(std::move(a));
+			bench::do_not_optimize(b);
+			a = std::move(b);
+			bench::do_not_optimize(a);
+		}
+	});
+}
+
+// The callable is hidden from the optimizer before every call, so that each
+// of them goes through the type-erased call path
+template <class Function, class Target>
+double invoke(Target &&t) {
+	return bench::measure([&t](size_t n) {
+		Function f(t);
+		int acc = 0;
+		for (size_t i = 0; i < n; ++i) {
+			bench::do_not_optimize(f);
+			acc += f((int)i);
+		}
+		sink = sink + acc;
+	});
+}
+
+template <size_t Size>
+void run_size() {
+	using libstra::function_ref;
+	using libstra::unique_function;
+	using Sig = int(int);
+	char label[32];
+	double construct[impl_count] = { -1, -1, -1, -1 };
+	double moves[impl_count] = { -1, -1, -1, -1 };
+	double calls[impl_count] = { -1, -1, -1, -1 };
+
+	payload<Size> p{};
+	construct[fn_ref] = construct_destroy<function_ref<Sig>, Size>();
+	construct[unique_fn] = construct_destroy<unique_function<Sig>, Size>();
+	construct[std_fn] = construct_destroy<std::function<Sig>, Size>();
+	moves[fn_ref] = move<function_ref<Sig>, Size>();
+	moves[unique_fn] = move<unique_function<Sig>, Size>();
+	moves[std_fn] = move<std::function<Sig>, Size>();
+	calls[fn_ref] = invoke<function_ref<Sig>>(p);
+	calls[unique_fn] = invoke<unique_function<Sig>>(p);
+	calls[std_fn] = invoke<std::function<Sig>>(p);
+	// a function pointer can't hold any state
+	if (!Size) calls[fn_ptr] = invoke<Sig *>(&raw_function);
+
+	std::snprintf(label, sizeof(label), "%zu bytes", Size);
+	bench::print_header(label, impl_names, impl_count);
+	bench::print_row("construct", construct, impl_count);
+	bench::print_row("move", moves, impl_count);
+	bench::print_row("invoke", calls, impl_count);
+}
+
+/* Pushes N function objects in a queue, then pops and invokes them, the way
+ * thread_pool does */
+template <class Function>
+double queue_throughput() {
+	using clock = std::chrono::steady_clock;
+	std::queue<Function> q;
+	auto start = clock::now();
+	for (size_t i = 0; i < N; i++) {
+		void *p = &q;
+		q.emplace([i, p]() { sink = sink + i + (p != nullptr); });
+	}
+	while (!q.empty()) {
+		auto f = std::move(q.front());
+		q.pop();
+		f();
+	}
+	std::chrono::duration<double, std::nano> d = clock::now() - start;
+	return d.count() / N;
+}
+
+int main() {
+	using libstra::unique_function;
+	std::printf("sizeof(unique_function<void()>): %zu\n",
+				sizeof(unique_function<void()>));
+	std::printf("sizeof(std::function<void()>): %zu\n",
+				sizeof(std::function<void()>));
+
+	run_size<0>();
+	run_size<8>();
+	run_size<16>();
+	run_size<32>();
+	run_size<64>();
+
+	std::printf("\nqueue push/pop/invoke, unique_function: %.2f ns/task\n",
+				queue_throughput<unique_function<void()>>());
+	std::printf("queue push/pop/invoke, std::function: %.2f ns/task\n",
+				queue_throughput<std::function<void()>>());
+}
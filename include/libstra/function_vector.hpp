@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <libstra/unique_function.hpp>
+
+namespace libstra {
+	/**
+	 * A sequence of type-erased callable objects of different types, packed
+	 * back to back in a single growable buffer. Invoking all of them walks
+	 * the buffer linearly, and clearing the sequence doesn't release any
+	 * memory per callable object
+	 * @tparam Func: The underlying function type, which can't take rvalue
+	 * references
+	 */
+	template <class Func>
+	class function_vector;
+
+	template <class R, typename... Args>
+	class function_vector<R(Args...)> {
+		// The first callable object could move from the argument, and the
+		// next ones would get a moved-from object
+		static_assert(
+			_details::all_v<!std::is_rvalue_reference<Args>::value...>,
+			"function_vector can't pass rvalue references to several callable "
+			"objects, take the arguments by value instead");
+		using traits = _details::sig_traits<R(Args...)>;
+		using ops_t = typename traits::ops_type;
+
+		// Precedes every callable object in the buffer
+		struct alignas(std::max_align_t) header {
+			const ops_t *ops;
+			// The distance to the next header, in bytes
+			size_t stride;
+		};
+		// Objects which can be relocated without throwing are stored in the
+		// buffer, others are allocated on the heap
+		template <class T>
+		static constexpr bool is_inline_v =
+			std::is_nothrow_move_constructible<T>::value ||
+			is_trivially_relocatable_v<T>;
+		template <class T>
+		using storage_t = _details::erased_storage<T, is_inline_v<T>>;
+
+	public:
+		/** Constructs an empty function_vector, without allocating */
+		constexpr function_vector() noexcept = default;
+		function_vector(const function_vector &) = delete;
+		/**
+		 * Constructs a function_vector by taking ownership of the buffer of
+		 * another
+		 * @param other: The object to move from, which is left empty
+		 */
+		function_vector(function_vector &&other) noexcept :
+			_buf(other._buf), _size(other._size), _cap(other._cap),
+			_count(other._count), _non_trivial(other._non_trivial) {
+			other._buf = nullptr;
+			other._size = other._cap = other._count = 0;
+			other._non_trivial = 0;
+		}
+		function_vector &operator=(const function_vector &) = delete;
+		function_vector &operator=(function_vector &&other) noexcept {
+			function_vector tmp(std::move(other));
+			swap(tmp);
+			return *this;
+		}
+		void swap(function_vector &other) noexcept {
+			std::swap(_buf, other._buf);
+			std::swap(_size, other._size);
+			std::swap(_cap, other._cap);
+			std::swap(_count, other._count);
+			std::swap(_non_trivial, other._non_trivial);
+		}
+
+		/**
+		 * Appends a callable object at the end of the buffer, which is grown if
+		 * needed
+		 * @param f: The callable object to store
+		 */
+		template <class F, typename = std::enable_if_t<
+							   traits::template accepts<F>>>
+		void push_back(F &&f) {
+			using _Raw = std::decay_t<F>;
+			using _Store = storage_t<_Raw>;
+			static_assert(alignof(_Raw) <= alignof(header),
+						  "Over-aligned callable objects are not supported");
+			constexpr size_t size =
+				sizeof(_Raw) > sizeof(void *) ? sizeof(_Raw) : sizeof(void *);
+			constexpr size_t stride =
+				sizeof(header) +
+				(size + sizeof(header) - 1) / sizeof(header) * sizeof(header);
+			reserve(_size + stride);
+			header *h = (header *)(_buf + _size);
+			_Store::create(h + 1, libstra::forward<F>(f));
+#if LIBSTRA_FUNCTION_STATS
+			_details::record_construction<_Raw>(_Store::heap_bytes);
+#endif
+			h->ops = _details::get_fn_ops<_Store, _Raw, R(Args...)>();
+			h->stride = stride;
+			_size += stride;
+			++_count;
+			if (!is_inline_v<_Raw> || !_Store::trivially_relocatable ||
+				!std::is_trivially_destructible<_Raw>::value)
+				++_non_trivial;
+		}
+
+		/**
+		 * Invokes every callable object, in the order they were added. Each of
+		 * them receives its own copy of the arguments which are passed by value
+		 * @param args: The arguments to pass to the callable objects
+		 */
+		void invoke_all(_details::param_t<Args>... args) {
+			for (size_t i = 0; i < _size;) {
+				header *h = (header *)(_buf + i);
+				h->ops->invoke(h + 1, pass<Args>(args)...);
+				i += h->stride;
+			}
+		}
+
+		/** @return The number of callable objects in the sequence */
+		[[nodiscard]]
+		size_t size() const noexcept {
+			return _count;
+		}
+		/** @return true if the sequence doesn't contain any callable object */
+		[[nodiscard]]
+		bool empty() const noexcept {
+			return !_count;
+		}
+		/** @return The size of the buffer, in bytes */
+		[[nodiscard]]
+		size_t capacity() const noexcept {
+			return _cap;
+		}
+
+		/**
+		 * Grows the buffer so that it can hold at least n bytes
+		 * @param n: The minimum capacity of the buffer, in bytes
+		 */
+		void reserve(size_t n) {
+			if (n <= _cap) return;
+			size_t cap = 2 * _cap > n ? 2 * _cap : n;
+			char *buf = (char *)::operator new(cap);
+			relocate_to(buf);
+			::operator delete(_buf);
+			_buf = buf;
+			_cap = cap;
+		}
+
+		/**
+		 * Destroys all the callable objects. The buffer is kept, to be reused
+		 * by subsequent calls to push_back. If none of the objects needs to be
+		 * destroyed, this doesn't touch the buffer
+		 */
+		void clear() noexcept {
+			if (_non_trivial) {
+				for (size_t i = 0; i < _size;) {
+					header *h = (header *)(_buf + i);
+					h->ops->destroy(h + 1);
+					i += h->stride;
+				}
+			}
+			_size = _count = _non_trivial = 0;
+		}
+
+		/** Destroys all the callable objects, and releases the buffer */
+		~function_vector() {
+			clear();
+			::operator delete(_buf);
+		}
+
+	private:
+		/* Each callable object gets its own copy of the arguments taken by
+		 * value, and lvalue references are passed as they are */
+		template <class T>
+		static T pass(std::remove_reference_t<T> &x) noexcept(
+			std::is_reference<T>::value ||
+			std::is_nothrow_copy_constructible<T>::value) {
+			return static_cast<T>(x);
+		}
+
+		// Moves all the objects to buf, which must be large enough to hold them
+		void relocate_to(char *buf) noexcept {
+			if (!_non_trivial) {
+				if (_size) std::memcpy(buf, _buf, _size);
+				return;
+			}
+			for (size_t i = 0; i < _size;) {
+				header *src = (header *)(_buf + i), *dst = (header *)(buf + i);
+				*dst = *src;
+				if (src->ops->relocate) src->ops->relocate(dst + 1, src + 1);
+				else
+					std::memcpy(dst + 1, src + 1, src->stride - sizeof(header));
+				i += src->stride;
+			}
+		}
+
+		char *_buf = nullptr;
+		size_t _size = 0, _cap = 0;
+		size_t _count = 0;
+		// The number of objects which can't be relocated with memcpy, or need
+		// to be destroyed
+		size_t _non_trivial = 0;
+	};
+} // namespace libstra
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <libstra/utility.hpp>
+
+namespace libstra {
+	namespace _details {
+		/**
+		 * Holds one element of an ebo_tuple. Empty classes are inherited
+		 * from rather than stored, so that they don't take any space
+		 */
+		template <size_t I, class T,
+				  bool = std::is_empty<T>::value && !std::is_final<T>::value>
+		struct ebo_leaf {
+			T _val;
+
+			template <class U>
+			constexpr ebo_leaf(U &&x) : _val(libstra::forward<U>(x)) {}
+			constexpr T &value() & noexcept { return _val; }
+			constexpr const T &value() const & noexcept { return _val; }
+			constexpr T &&value() && noexcept { return std::move(_val); }
+		};
+		template <size_t I, class T>
+		struct ebo_leaf<I, T, true> : T {
+			template <class U>
+			constexpr ebo_leaf(U &&x) : T(libstra::forward<U>(x)) {}
+			constexpr T &value() & noexcept { return *this; }
+			constexpr const T &value() const & noexcept { return *this; }
+			constexpr T &&value() && noexcept { return std::move(*this); }
+		};
+
+		/**
+		 * A minimal tuple, which doesn't use any storage for the elements of
+		 * empty class types
+		 */
+		template <class Indices, class... T>
+		struct ebo_tuple;
+		template <size_t... I, class... T>
+		struct ebo_tuple<index_sequence<I...>, T...> : ebo_leaf<I, T>... {
+			template <class... U>
+			constexpr ebo_tuple(in_place_t, U &&...x) :
+				ebo_leaf<I, T>(libstra::forward<U>(x))... {}
+		};
+
+		template <size_t I, class T>
+		constexpr T &get(ebo_leaf<I, T> &x) noexcept {
+			return x.value();
+		}
+		template <size_t I, class T>
+		constexpr const T &get(const ebo_leaf<I, T> &x) noexcept {
+			return x.value();
+		}
+		template <size_t I, class T>
+		constexpr T &&get(ebo_leaf<I, T> &&x) noexcept {
+			return std::move(x).value();
+		}
+
+		/**
+		 * A function or member pointer known at compile time, which is an
+		 * empty object
+		 */
+		template <class M, M V>
+		struct fn_constant {};
+
+		template <class T>
+		struct is_fn_constant : std::false_type {};
+		template <class M, M V>
+		struct is_fn_constant<fn_constant<M, V>> : std::true_type {};
+
+		template <class T>
+		struct is_reference_wrapper : std::false_type {};
+		template <class T>
+		struct is_reference_wrapper<std::reference_wrapper<T>>
+			: std::true_type {};
+
+		// The object a member pointer applies to, which may be given by
+		// reference, through a std::reference_wrapper or through a pointer
+		template <class C, class Obj,
+				  typename = std::enable_if_t<
+					  std::is_base_of<C, std::decay_t<Obj>>::value>>
+		constexpr Obj &&member_object(Obj &&obj) noexcept {
+			return libstra::forward<Obj>(obj);
+		}
+		template <class C, class Obj,
+				  typename = std::enable_if_t<
+					  is_reference_wrapper<std::decay_t<Obj>>::value>,
+				  typename = void>
+		constexpr auto member_object(Obj &&obj) noexcept -> decltype(obj.get()) {
+			return obj.get();
+		}
+		template <class C, class Obj,
+				  typename = std::enable_if_t<
+					  !std::is_base_of<C, std::decay_t<Obj>>::value &&
+					  !is_reference_wrapper<std::decay_t<Obj>>::value>,
+				  typename = void, typename = void>
+		constexpr auto member_object(Obj &&obj) noexcept(
+			noexcept(*libstra::forward<Obj>(obj)))
+			-> decltype(*libstra::forward<Obj>(obj)) {
+			return *libstra::forward<Obj>(obj);
+		}
+
+		/**
+		 * Calls f with args. If f is a pointer to member, the first argument
+		 * is the object (or a pointer to the object) it applies to
+		 */
+		template <class F, class... Args,
+				  typename = std::enable_if_t<
+					  !std::is_member_pointer<std::decay_t<F>>::value &&
+					  !is_fn_constant<std::decay_t<F>>::value>>
+		constexpr auto fn_invoke(F &&f, Args &&...args) noexcept(
+			noexcept(libstra::forward<F>(f)(libstra::forward<Args>(args)...)))
+			-> decltype(libstra::forward<F>(f)(
+				libstra::forward<Args>(args)...)) {
+			return libstra::forward<F>(f)(libstra::forward<Args>(args)...);
+		}
+		template <class M, class C, class Obj, class... Args,
+				  typename = std::enable_if_t<std::is_function<M>::value>>
+		constexpr auto fn_invoke(M C::*pm, Obj &&obj, Args &&...args) noexcept(
+			noexcept((member_object<C>(libstra::forward<Obj>(obj)).*
+					  pm)(libstra::forward<Args>(args)...)))
+			-> decltype((member_object<C>(libstra::forward<Obj>(obj)).*
+						 pm)(libstra::forward<Args>(args)...)) {
+			return (member_object<C>(libstra::forward<Obj>(obj)).*pm)(
+				libstra::forward<Args>(args)...);
+		}
+		template <class M, class C, class Obj,
+				  typename = std::enable_if_t<!std::is_function<M>::value>>
+		constexpr auto fn_invoke(M C::*pm, Obj &&obj) noexcept
+			-> decltype(member_object<C>(libstra::forward<Obj>(obj)).*pm) {
+			return member_object<C>(libstra::forward<Obj>(obj)).*pm;
+		}
+		template <class M, M V, class... Args>
+		constexpr auto fn_invoke(fn_constant<M, V>, Args &&...args) noexcept(
+			noexcept(fn_invoke(V, libstra::forward<Args>(args)...)))
+			-> decltype(fn_invoke(V, libstra::forward<Args>(args)...)) {
+			return fn_invoke(V, libstra::forward<Args>(args)...);
+		}
+
+		/**
+		 * The result of bind_front and bind_back: holds the callable object
+		 * followed by the bound arguments, without using any storage for
+		 * those which are empty
+		 * @tparam Back: Whether the bound arguments are passed after the
+		 * call arguments rather than before
+		 */
+		template <bool Back, class F, class... Bound>
+		class binder
+			: ebo_tuple<make_index_sequence<sizeof...(Bound) + 1>, F,
+						Bound...> {
+			using base =
+				ebo_tuple<make_index_sequence<sizeof...(Bound) + 1>, F,
+						  Bound...>;
+			using indices = make_index_sequence<sizeof...(Bound)>;
+
+			template <class Self, size_t... I, class... Args>
+			static constexpr auto
+			call(std::false_type, index_sequence<I...>, Self &&self,
+				 Args &&...args) noexcept(noexcept(fn_invoke(
+				_details::get<0>(libstra::forward<Self>(self)),
+				_details::get<I + 1>(libstra::forward<Self>(self))...,
+				libstra::forward<Args>(args)...)))
+				-> decltype(fn_invoke(
+					_details::get<0>(libstra::forward<Self>(self)),
+					_details::get<I + 1>(libstra::forward<Self>(self))...,
+					libstra::forward<Args>(args)...)) {
+				return fn_invoke(_details::get<0>(libstra::forward<Self>(self)),
+								 _details::get<I + 1>(libstra::forward<Self>(self))...,
+								 libstra::forward<Args>(args)...);
+			}
+			template <class Self, size_t... I, class... Args>
+			static constexpr auto
+			call(std::true_type, index_sequence<I...>, Self &&self,
+				 Args &&...args) noexcept(noexcept(fn_invoke(
+				_details::get<0>(libstra::forward<Self>(self)),
+				libstra::forward<Args>(args)...,
+				_details::get<I + 1>(libstra::forward<Self>(self))...)))
+				-> decltype(fn_invoke(
+					_details::get<0>(libstra::forward<Self>(self)),
+					libstra::forward<Args>(args)...,
+					_details::get<I + 1>(libstra::forward<Self>(self))...)) {
+				return fn_invoke(_details::get<0>(libstra::forward<Self>(self)),
+								 libstra::forward<Args>(args)...,
+								 _details::get<I + 1>(libstra::forward<Self>(self))...);
+			}
+
+		public:
+			template <class... U>
+			constexpr binder(in_place_t, U &&...x) :
+				base(in_place_t{}, libstra::forward<U>(x)...) {}
+
+			template <class... Args>
+			constexpr auto operator()(Args &&...args) & noexcept(
+				noexcept(call(std::integral_constant<bool, Back>{}, indices{},
+							  std::declval<base &>(),
+							  libstra::forward<Args>(args)...)))
+				-> decltype(call(std::integral_constant<bool, Back>{},
+								 indices{}, std::declval<base &>(),
+								 libstra::forward<Args>(args)...)) {
+				return call(std::integral_constant<bool, Back>{}, indices{},
+							static_cast<base &>(*this),
+							libstra::forward<Args>(args)...);
+			}
+			template <class... Args>
+			constexpr auto operator()(Args &&...args) const & noexcept(
+				noexcept(call(std::integral_constant<bool, Back>{}, indices{},
+							  std::declval<const base &>(),
+							  libstra::forward<Args>(args)...)))
+				-> decltype(call(std::integral_constant<bool, Back>{},
+								 indices{}, std::declval<const base &>(),
+								 libstra::forward<Args>(args)...)) {
+				return call(std::integral_constant<bool, Back>{}, indices{},
+							static_cast<const base &>(*this),
+							libstra::forward<Args>(args)...);
+			}
+			// The bound arguments are moved from
+			template <class... Args>
+			constexpr auto operator()(Args &&...args) && noexcept(
+				noexcept(call(std::integral_constant<bool, Back>{}, indices{},
+							  std::declval<base>(),
+							  libstra::forward<Args>(args)...)))
+				-> decltype(call(std::integral_constant<bool, Back>{},
+								 indices{}, std::declval<base>(),
+								 libstra::forward<Args>(args)...)) {
+				return call(std::integral_constant<bool, Back>{}, indices{},
+							static_cast<base &&>(*this),
+							libstra::forward<Args>(args)...);
+			}
+
+		};
+	} // namespace _details
+
+	/**
+	 * Binds the first arguments of a callable object. The result stores
+	 * decayed copies of f and args, empty objects taking no space, so that it
+	 * fits in the inline buffer of a unique_function whenever possible
+	 * @param f: The callable object. It may be a pointer to member, in which
+	 * case the first bound argument is the object, or a pointer to it
+	 * @param args: The arguments to pass before those of the call
+	 * @return A callable object, which calls f with args followed by the
+	 * arguments it receives
+	 */
+	template <class F, class... Args>
+	constexpr auto bind_front(F &&f, Args &&...args) {
+		return _details::binder<false, std::decay_t<F>, std::decay_t<Args>...>(
+			in_place_t{}, libstra::forward<F>(f),
+			libstra::forward<Args>(args)...);
+	}
+	/**
+	 * Binds the last arguments of a callable object, see bind_front
+	 * @param f: The callable object
+	 * @param args: The arguments to pass after those of the call
+	 * @return A callable object, which calls f with the arguments it receives
+	 * followed by args
+	 */
+	template <class F, class... Args>
+	constexpr auto bind_back(F &&f, Args &&...args) {
+		return _details::binder<true, std::decay_t<F>, std::decay_t<Args>...>(
+			in_place_t{}, libstra::forward<F>(f),
+			libstra::forward<Args>(args)...);
+	}
+
+#if __cpp_nontype_template_parameter_auto
+	/**
+	 * Binds the first arguments of a function, or of a member function, known
+	 * at compile time. The pointer to the function is not stored, which
+	 * makes binding an object pointer to a member function as small as the
+	 * object pointer itself
+	 * @tparam F: The function, or pointer to member
+	 * @param args: The arguments to pass before those of the call
+	 */
+	template <auto F, class... Args>
+	constexpr auto bind_front(Args &&...args) {
+		return _details::binder<false, _details::fn_constant<decltype(F), F>,
+								std::decay_t<Args>...>(
+			in_place_t{}, _details::fn_constant<decltype(F), F>{},
+			libstra::forward<Args>(args)...);
+	}
+	/**
+	 * Binds the last arguments of a function known at compile time, see
+	 * bind_front
+	 * @tparam F: The function, or pointer to member
+	 * @param args: The arguments to pass after those of the call
+	 */
+	template <auto F, class... Args>
+	constexpr auto bind_back(Args &&...args) {
+		return _details::binder<true, _details::fn_constant<decltype(F), F>,
+								std::decay_t<Args>...>(
+			in_place_t{}, _details::fn_constant<decltype(F), F>{},
+			libstra::forward<Args>(args)...);
+	}
+#endif
+} // namespace libstra
@@ -0,0 +1,589 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <libstra/functional.hpp>
+#include <libstra/thread_pool.hpp>
+#include <libstra/utility.hpp>
+
+namespace libstra {
+	// Exception stored in a future when its promise is destroyed without
+	// setting a result
+	struct broken_promise {
+		constexpr const char *what() const noexcept {
+			return "The promise was destroyed without setting a result";
+		}
+	};
+
+	template <class R>
+	class future;
+	template <class R>
+	class promise;
+
+	namespace _details {
+		struct unit {};
+		template <class R>
+		using future_value_t =
+			std::conditional_t<std::is_void<R>::value, unit, R>;
+
+		/**
+		 * The part of the shared state of a future which doesn't depend on
+		 * the type of its result. States are reference counted, and may have
+		 * a next state, which is notified once the result is set: either a
+		 * continuation, or a combinator waiting on several futures
+		 */
+		class state_base {
+		public:
+			using notify_fn = void (*)(state_base *self,
+									   state_base *from) noexcept;
+			using destroy_fn = void (*)(state_base *self) noexcept;
+
+			state_base(notify_fn notify, destroy_fn destroy,
+					   thread_pool *pool) noexcept :
+				_notify(notify),
+				_destroy(destroy), _pool(pool) {}
+			state_base(state_base &) = delete;
+			state_base(state_base &&) = delete;
+
+			void add_ref() noexcept {
+				_refs.fetch_add(1, std::memory_order_relaxed);
+			}
+			void release() noexcept {
+				if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					_destroy(this);
+			}
+			[[nodiscard]]
+			bool ready() const noexcept {
+				return _ready.load(std::memory_order_acquire);
+			}
+			/* The pool continuations are scheduled on, may be null. It is
+			 * forgotten once the result is set, as the pool may be destroyed
+			 * before the future */
+			[[nodiscard]]
+			thread_pool *pool() const noexcept {
+				return _pool.load(std::memory_order_relaxed);
+			}
+			void wait();
+			template <class Rep, class Period>
+			bool wait_for(const std::chrono::duration<Rep, Period> &d) {
+				if (ready()) return true;
+				std::unique_lock<std::mutex> lk(_m);
+				return _cv.wait_for(lk, d, [this]() { return this->ready(); });
+			}
+			// Notifies next once this state is ready, which may be right away
+			void set_next(state_base *next) noexcept;
+
+		protected:
+			// Called once the result is stored
+			void complete() noexcept;
+
+		private:
+			const notify_fn _notify;
+			const destroy_fn _destroy;
+			std::atomic<thread_pool *> _pool;
+			std::atomic<size_t> _refs{ 1 };
+			std::atomic<bool> _ready{ false };
+			// Guarded by _m
+			state_base *_next = nullptr;
+			std::mutex _m;
+			std::condition_variable _cv;
+		};
+
+		template <class R>
+		class future_state : public state_base {
+			using _Val = future_value_t<R>;
+
+		public:
+			using state_base::state_base;
+			~future_state() {
+				if (_has_value) get_ptr()->~_Val();
+			}
+
+			template <typename... Args>
+			void set_value(Args &&...args) {
+				new (_buf) _Val(libstra::forward<Args>(args)...);
+				_has_value = true;
+				complete();
+			}
+			void set_exception(std::exception_ptr e) noexcept {
+				_error = std::move(e);
+				complete();
+			}
+			// Waits for the result, and moves it out of the state
+			_Val take() {
+				wait();
+				if (_error) std::rethrow_exception(_error);
+				return std::move(*get_ptr());
+			}
+
+		private:
+			_Val *get_ptr() noexcept { return (_Val *)_buf; }
+
+			std::exception_ptr _error;
+			bool _has_value = false;
+			alignas(_Val) unsigned char _buf[sizeof(_Val)];
+		};
+
+		// The state shared by a promise and its future
+		template <class R>
+		class promise_state : public future_state<R> {
+		public:
+			promise_state() noexcept :
+				future_state<R>(&notify, &destroy, nullptr) {}
+
+		private:
+			static void notify(state_base *, state_base *) noexcept {}
+			static void destroy(state_base *s) noexcept {
+				delete static_cast<promise_state *>(s);
+			}
+		};
+
+		/**
+		 * The state of a future returned by async or then, which also holds
+		 * the task computing its result. The task is scheduled on the pool
+		 * when the state is notified, that is when the parent future of a
+		 * continuation is ready
+		 */
+		template <class R, class F>
+		class task_state : public future_state<R> {
+		public:
+			task_state(thread_pool *pool, F &&f) :
+				future_state<R>(&notify, &destroy, pool), _f(std::move(f)) {}
+
+			/* Queues the task on the pool. If it is destroyed without being
+			 * run, including when this throws, the future gets a
+			 * broken_promise exception instead */
+			void post() {
+				this->add_ref();
+				this->pool()->post(queued(this));
+			}
+			void run() noexcept {
+				try {
+					call(std::is_void<R>{});
+				} catch (...) {
+					this->set_exception(std::current_exception());
+				}
+			}
+
+		private:
+			// The reference the pool's task holds on the state
+			class queued {
+			public:
+				explicit queued(task_state *s) noexcept : _s(s) {}
+				queued(queued &&other) noexcept : _s(other._s) {
+					other._s = nullptr;
+				}
+				~queued() {
+					if (!_s) return;
+					_s->set_exception(
+						std::make_exception_ptr(broken_promise{}));
+					_s->release();
+				}
+				void operator()() noexcept {
+					task_state *s = _s;
+					_s = nullptr;
+					s->run();
+					s->release();
+				}
+
+			private:
+				task_state *_s;
+			};
+
+			void call(std::true_type) {
+				std::move(_f)();
+				this->set_value();
+			}
+			void call(std::false_type) { this->set_value(std::move(_f)()); }
+
+			static void notify(state_base *self, state_base *) noexcept {
+				auto s = static_cast<task_state *>(self);
+				if (!s->pool()) return s->run();
+				try {
+					s->post();
+				} catch (...) {
+					// the state holds a broken_promise already
+				}
+			}
+			static void destroy(state_base *s) noexcept {
+				delete static_cast<task_state *>(s);
+			}
+
+			F _f;
+		};
+
+		// Passes the result of a future to a continuation
+		template <class F, class T>
+		decltype(auto) continue_with(F &f, future<T> &fut, std::false_type) {
+			return std::move(f)(fut.get());
+		}
+		template <class F, class T>
+		decltype(auto) continue_with(F &f, future<T> &fut, std::true_type) {
+			fut.get();
+			return std::move(f)();
+		}
+
+		template <class Fut>
+		class when_all_state;
+		template <class Fut>
+		class when_any_state;
+	} // namespace _details
+
+	/**
+	 * Holds the eventual result of an asynchronous operation, like
+	 * std::future. Unlike std::future, it supports continuations with then,
+	 * which don't block any thread while they wait
+	 * @tparam R: The type of the result, which may be void
+	 */
+	template <class R>
+	class future {
+		static_assert(!std::is_reference<R>::value,
+					  "The result of a future can't be a reference");
+
+	public:
+		/** Constructs an invalid future */
+		constexpr future() noexcept = default;
+		future(future &&other) noexcept : _state(other._state) {
+			other._state = nullptr;
+		}
+		future &operator=(future &&other) noexcept {
+			future(std::move(other)).swap(*this);
+			return *this;
+		}
+		~future() {
+			if (_state) _state->release();
+		}
+		void swap(future &other) noexcept { std::swap(_state, other._state); }
+
+		/**
+		 * @return true if the future refers to a shared state, i.e. it hasn't
+		 * been consumed by get, then, or a combinator
+		 */
+		[[nodiscard]]
+		bool valid() const noexcept {
+			return _state;
+		}
+		/** @return true if the result is available */
+		[[nodiscard]]
+		bool ready() const noexcept {
+			return _state->ready();
+		}
+		/** Blocks until the result is available */
+		void wait() const { _state->wait(); }
+		/**
+		 * Blocks until the result is available, or the given amount of time
+		 * has passed
+		 * @return std::future_status::ready if the result is available,
+		 * std::future_status::timeout otherwise
+		 */
+		template <class Rep, class Period>
+		std::future_status
+		wait_for(const std::chrono::duration<Rep, Period> &d) const {
+			return _state->wait_for(d) ? std::future_status::ready
+									   : std::future_status::timeout;
+		}
+		/**
+		 * Waits for the result and returns it, or rethrows the exception
+		 * which was stored instead. The future is no longer valid afterwards
+		 * @note From one of the pool's tasks, use thread_pool::wait_for first,
+		 * so that the thread runs other tasks in the meantime
+		 */
+		R get() {
+			future tmp(std::move(*this));
+			return (R)tmp._state->take();
+		}
+		/**
+		 * Attaches a continuation, which is invoked with the result once it
+		 * is available. The continuation is queued on the pool which produced
+		 * this future, or invoked by the thread making it ready if it comes
+		 * from a promise. If the result is already available, it is invoked
+		 * right away by the calling thread, so the pool doesn't need to
+		 * outlive the future. If this future holds an exception, the
+		 * continuation isn't invoked, and the exception is passed on to the
+		 * returned future
+		 * @param f: The callable object to invoke with the result, or without
+		 * arguments if R is void
+		 * @return A future holding the result of f. This future is no longer
+		 * valid afterwards
+		 */
+		template <class F>
+		auto then(F &&f) {
+			_details::state_base *parent = _state;
+			auto fn = [p = std::move(*this),
+					   f = std::decay_t<F>(libstra::forward<F>(f))]() mutable {
+				return _details::continue_with(f, p, std::is_void<R>{});
+			};
+			using _Res = decltype(fn());
+			using _State = _details::task_state<_Res, decltype(fn)>;
+			auto s = new _State(parent->pool(), std::move(fn));
+			future<_Res> res(s);
+			parent->set_next(s);
+			return res;
+		}
+
+	private:
+		template <class>
+		friend class future;
+		template <class>
+		friend class promise;
+		template <class>
+		friend class _details::when_all_state;
+		template <class>
+		friend class _details::when_any_state;
+		template <class F, typename... Args>
+		friend auto async(thread_pool &pool, F &&f, Args &&...args);
+		template <class It>
+		friend auto when_all(It first, It last);
+		template <class It>
+		friend auto when_any(It first, It last);
+
+		explicit future(_details::future_state<R> *s) noexcept : _state(s) {}
+
+		_details::future_state<R> *_state = nullptr;
+	};
+
+	/**
+	 * Sets the result of the future it was created with, like std::promise
+	 * @tparam R: The type of the result, which may be void
+	 */
+	template <class R>
+	class promise {
+	public:
+		/** Allocates a new shared state */
+		promise() : _state(new _details::promise_state<R>) {}
+		promise(promise &&other) noexcept : _state(other._state) {
+			other._state = nullptr;
+		}
+		promise &operator=(promise &&other) noexcept {
+			promise(std::move(other)).swap(*this);
+			return *this;
+		}
+		/**
+		 * Releases the shared state. If no result was set, a broken_promise
+		 * exception is stored instead
+		 */
+		~promise() {
+			if (!_state) return;
+			if (!_state->ready()) {
+				_state->set_exception(
+					std::make_exception_ptr(broken_promise{}));
+			}
+			_state->release();
+		}
+		void swap(promise &other) noexcept { std::swap(_state, other._state); }
+
+		/**
+		 * @return The future associated with the promise. Must only be called
+		 * once
+		 */
+		[[nodiscard]]
+		future<R> get_future() {
+			_state->add_ref();
+			return future<R>(_state);
+		}
+		/**
+		 * Stores the result, and makes the future ready. The result must be
+		 * set only once
+		 * @param args: The arguments to construct the result with, none if R
+		 * is void
+		 */
+		template <typename... Args>
+		void set_value(Args &&...args) {
+			_state->set_value(libstra::forward<Args>(args)...);
+		}
+		/**
+		 * Stores an exception, and makes the future ready. The result must be
+		 * set only once
+		 * @param e: The exception to store
+		 */
+		void set_exception(std::exception_ptr e) noexcept {
+			_state->set_exception(std::move(e));
+		}
+
+	private:
+		_details::promise_state<R> *_state;
+	};
+
+	/**
+	 * Adds a task to the queue of a pool, like thread_pool::enqueue_task. The
+	 * task and the shared state of the future are stored in a single
+	 * allocation
+	 * @param pool: The pool to run the task on, as well as its continuations
+	 * @param f: The callable object to invoke. It may be a pointer to
+	 * member, in which case the first argument is the object
+	 * @param Args: The arguments to pass to f
+	 * @return The future holding the result of the task
+	 * @note If the callable object takes arguments by reference, you
+	 * MUST wrap the references, using std::ref
+	 * @note If the pool is destroyed before running the task, the future
+	 * holds a broken_promise exception
+	 */
+	template <class F, typename... Args>
+	[[nodiscard]]
+	auto async(thread_pool &pool, F &&f, Args &&...args) {
+		auto bound = libstra::bind_front(libstra::forward<F>(f),
+										 libstra::forward<Args>(args)...);
+		using _Res = decltype(std::move(bound)());
+		using _State = _details::task_state<_Res, decltype(bound)>;
+		auto s = new _State(&pool, std::move(bound));
+		future<_Res> res(s);
+		s->post();
+		return res;
+	}
+
+	/**
+	 * The result of when_any: the futures which were passed to it, and the
+	 * index of the first one which got ready
+	 */
+	template <class Seq>
+	struct when_any_result {
+		// size_t(-1) if there were no futures
+		size_t index;
+		Seq futures;
+	};
+
+	namespace _details {
+		template <class Fut>
+		class when_all_state : public future_state<std::vector<Fut>> {
+		public:
+			template <class It>
+			when_all_state(It first, It last) :
+				future_state<std::vector<Fut>>(&notify, &destroy, nullptr),
+				_futures(std::make_move_iterator(first),
+						 std::make_move_iterator(last)),
+				_left(_futures.size() + 1) {}
+
+			void start() noexcept {
+				for (auto &f : _futures) {
+					if (f._state) f._state->set_next(this);
+					else notify(this, nullptr);
+				}
+				// the state can't be ready before this
+				notify(this, nullptr);
+			}
+
+		private:
+			static void notify(state_base *self, state_base *) noexcept {
+				auto s = static_cast<when_all_state *>(self);
+				if (s->_left.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					s->set_value(std::move(s->_futures));
+			}
+			static void destroy(state_base *s) noexcept {
+				delete static_cast<when_all_state *>(s);
+			}
+
+			std::vector<Fut> _futures;
+			std::atomic<size_t> _left;
+		};
+
+		template <class Fut>
+		class when_any_state
+			: public future_state<when_any_result<std::vector<Fut>>> {
+		public:
+			template <class It>
+			when_any_state(It first, It last) :
+				future_state<when_any_result<std::vector<Fut>>>(
+					&notify, &destroy, nullptr),
+				_futures(std::make_move_iterator(first),
+						 std::make_move_iterator(last)),
+				_left(_futures.empty() ? 1 : 2) {
+				_inputs.reserve(_futures.size());
+				for (auto &f : _futures)
+					_inputs.push_back(f._state);
+			}
+
+			void start() noexcept {
+				for (size_t i = 0; i < _inputs.size(); ++i) {
+					if (_inputs[i]) _inputs[i]->set_next(this);
+					else win(i);
+				}
+				// the state can't be ready before this
+				arrive();
+			}
+
+		private:
+			/* _futures is moved into the result once there is a winner, so the
+			 * futures which get ready later are looked up in _inputs */
+			static void notify(state_base *self, state_base *from) noexcept {
+				auto s = static_cast<when_any_state *>(self);
+				if (s->_winner.load(std::memory_order_relaxed) != size_t(-1))
+					return;
+				for (size_t i = 0; i < s->_inputs.size(); ++i) {
+					if (s->_inputs[i] == from) {
+						s->win(i);
+						return;
+					}
+				}
+			}
+			static void destroy(state_base *s) noexcept {
+				delete static_cast<when_any_state *>(s);
+			}
+			// Records the first future to get ready
+			void win(size_t i) noexcept {
+				size_t none = size_t(-1);
+				if (_winner.compare_exchange_strong(none, i,
+													std::memory_order_relaxed))
+					arrive();
+			}
+			void arrive() noexcept {
+				if (_left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					this->set_value(when_any_result<std::vector<Fut>>{
+						_winner.load(std::memory_order_relaxed),
+						std::move(_futures) });
+				}
+			}
+
+			std::vector<Fut> _futures;
+			// The states of the futures, only compared with the notifying
+			// state once start is done
+			std::vector<state_base *> _inputs;
+			std::atomic<size_t> _winner{ size_t(-1) };
+			std::atomic<int> _left;
+		};
+	} // namespace _details
+
+	/**
+	 * Creates a future which gets ready once all the futures of a range are
+	 * @param first: The beginning of the range of futures, which are moved
+	 * from
+	 * @param last: The end of the range
+	 * @return A future holding the futures of the range, all of them ready
+	 */
+	template <class It>
+	[[nodiscard]]
+	auto when_all(It first, It last) {
+		using _Fut = typename std::iterator_traits<It>::value_type;
+		auto s = new _details::when_all_state<_Fut>(first, last);
+		future<std::vector<_Fut>> res(s);
+		s->start();
+		return res;
+	}
+
+	/**
+	 * Creates a future which gets ready once any of the futures of a range is
+	 * @param first: The beginning of the range of futures, which are moved
+	 * from
+	 * @param last: The end of the range
+	 * @return A future holding the futures of the range, and the index of the
+	 * first one which got ready. If the range is empty, it is ready right
+	 * away
+	 */
+	template <class It>
+	[[nodiscard]]
+	auto when_any(It first, It last) {
+		using _Fut = typename std::iterator_traits<It>::value_type;
+		auto s = new _details::when_any_state<_Fut>(first, last);
+		future<when_any_result<std::vector<_Fut>>> res(s);
+		s->start();
+		return res;
+	}
+} // namespace libstra
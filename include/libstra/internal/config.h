@@ -0,0 +1,30 @@
+#ifndef LIBSTRA_CONFIG_H
+#define LIBSTRA_CONFIG_H
+
+/* LIBSTRA_HAS_RTTI is 1 if run-time type information is available, which is
+ * detected from the compiler flags. Defining LIBSTRA_NO_RTTI disables the
+ * features relying on it even if it is available */
+#if !defined(LIBSTRA_NO_RTTI) &&                                               \
+	(defined(__cpp_rtti) || defined(__GXX_RTTI) || defined(_CPPRTTI))
+#define LIBSTRA_HAS_RTTI 1
+#else
+#define LIBSTRA_HAS_RTTI 0
+#endif
+
+/* LIBSTRA_HAS_COROUTINES is 1 if the C++20 coroutines are available, in which
+ * case the type-erased function objects and the thread pool can hold
+ * std::coroutine_handle objects */
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine) &&                \
+	__has_include(<coroutine>)
+#define LIBSTRA_HAS_COROUTINES 1
+#else
+#define LIBSTRA_HAS_COROUTINES 0
+#endif
+
+/* Defining LIBSTRA_FUNCTION_STATS to 1 makes the type-erased function objects
+ * record how their targets are stored, see libstra::function_stats */
+#ifndef LIBSTRA_FUNCTION_STATS
+#define LIBSTRA_FUNCTION_STATS 0
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace libstra {
+	namespace _details {
+		// Used to keep the variables written by different threads on
+		// separate cache lines
+		static constexpr size_t cache_line_size = 64;
+	} // namespace _details
+
+	/**
+	 * A bounded lock-free queue, which supports any number of concurrent
+	 * producers and consumers (D. Vyukov's algorithm). Each slot holds a
+	 * sequence number, which tells producers and consumers whether it is
+	 * ready to be written or read
+	 * @tparam T: The type of elements, which must be nothrow move
+	 * constructible and assignable
+	 */
+	template <class T>
+	class mpmc_queue {
+		static_assert(std::is_nothrow_move_constructible<T>::value &&
+						  std::is_nothrow_move_assignable<T>::value,
+					  "The elements of an mpmc_queue must be nothrow movable");
+
+		struct cell {
+			std::atomic<size_t> seq;
+			alignas(T) unsigned char buf[sizeof(T)];
+
+			T *get() noexcept { return (T *)buf; }
+		};
+
+	public:
+		/**
+		 * Constructs the queue
+		 * @param capacity: The maximum number of elements, which is rounded
+		 * up to a power of 2
+		 */
+		explicit mpmc_queue(size_t capacity) {
+			size_t n = 2;
+			while (n < capacity)
+				n *= 2;
+			_cells = new cell[n];
+			_mask = n - 1;
+			for (size_t i = 0; i < n; ++i)
+				_cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+		mpmc_queue(const mpmc_queue &) = delete;
+		mpmc_queue &operator=(const mpmc_queue &) = delete;
+		/** Destroys the remaining elements, and releases the memory */
+		~mpmc_queue() {
+			size_t head = _head.load(std::memory_order_relaxed);
+			for (size_t pos = _tail.load(std::memory_order_relaxed); pos != head;
+				 ++pos)
+				_cells[pos & _mask].get()->~T();
+			delete[] _cells;
+		}
+
+		/**
+		 * Attempts to add an element at the end of the queue
+		 * @param x: The element to move into the queue
+		 * @return true if the element was added, false if the queue was
+		 * full, in which case x is left untouched
+		 */
+		bool try_push(T &&x) noexcept {
+			size_t pos = _head.load(std::memory_order_relaxed);
+			cell *c;
+			for (;;) {
+				c = _cells + (pos & _mask);
+				size_t seq = c->seq.load(std::memory_order_acquire);
+				std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+				if (!diff) {
+					if (_head.compare_exchange_weak(pos, pos + 1,
+													std::memory_order_relaxed))
+						break;
+				} else if (diff < 0) return false;
+				else pos = _head.load(std::memory_order_relaxed);
+			}
+			new (c->buf) T(std::move(x));
+			c->seq.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Attempts to remove the first element of the queue
+		 * @param out: The object to move the element into
+		 * @return true if an element was removed, false if the queue was
+		 * empty
+		 */
+		bool try_pop(T &out) noexcept {
+			size_t pos = _tail.load(std::memory_order_relaxed);
+			cell *c;
+			for (;;) {
+				c = _cells + (pos & _mask);
+				size_t seq = c->seq.load(std::memory_order_acquire);
+				std::ptrdiff_t diff =
+					(std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+				if (!diff) {
+					if (_tail.compare_exchange_weak(pos, pos + 1,
+													std::memory_order_relaxed))
+						break;
+				} else if (diff < 0) return false;
+				else pos = _tail.load(std::memory_order_relaxed);
+			}
+			out = std::move(*c->get());
+			c->get()->~T();
+			c->seq.store(pos + _mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		/** @return The maximum number of elements */
+		[[nodiscard]]
+		size_t capacity() const noexcept {
+			return _mask + 1;
+		}
+		/**
+		 * @return The number of elements in the queue. This is only an
+		 * estimate if other threads are using the queue concurrently
+		 */
+		[[nodiscard]]
+		size_t size_approx() const noexcept {
+			size_t head = _head.load(std::memory_order_relaxed);
+			size_t tail = _tail.load(std::memory_order_relaxed);
+			return head > tail ? head - tail : 0;
+		}
+
+	private:
+		/* The positions are padded rather than aligned, so that the queue
+		 * doesn't need an over-aligned allocation */
+		cell *_cells;
+		size_t _mask;
+		char _pad0[_details::cache_line_size];
+		std::atomic<size_t> _head{ 0 };
+		char _pad1[_details::cache_line_size - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> _tail{ 0 };
+		char _pad2[_details::cache_line_size - sizeof(std::atomic<size_t>)];
+	};
+} // namespace libstra
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <libstra/thread_pool.hpp>
+#include <libstra/utility.hpp>
+
+namespace libstra {
+	namespace _details {
+		/* Shared by the threads taking part in a parallel loop over [0, n),
+		 * which claim chunks of it until there are none left. The chunks get
+		 * smaller as the loop progresses, so that the threads finish at about
+		 * the same time without claiming too many chunks */
+		class parallel_state {
+		public:
+			parallel_state(size_t n, size_t grain, size_t workers) noexcept;
+			parallel_state(parallel_state &) = delete;
+			parallel_state(parallel_state &&) = delete;
+
+			// Claims the next chunk, returns false if there is none left
+			bool claim(size_t &lo, size_t &hi) noexcept;
+			// Runs body on chunks until there are none left. If it throws, the
+			// remaining chunks are cancelled
+			template <class Body>
+			void work(Body &body) noexcept {
+				size_t lo, hi, count = 0;
+				std::exception_ptr e;
+				while (claim(lo, hi)) {
+					count += hi - lo;
+					try {
+						body(lo, hi);
+					} catch (...) {
+						e = std::current_exception();
+						size_t i =
+							_next.exchange(_n, std::memory_order_relaxed);
+						if (i < _n) count += _n - i;
+					}
+				}
+				finish(count, std::move(e));
+			}
+			// Waits until all chunks are done, and rethrows the first exception
+			void wait();
+
+		private:
+			void finish(size_t count, std::exception_ptr e) noexcept;
+
+			const size_t _n, _grain, _workers;
+			std::atomic<size_t> _next{ 0 };
+			// Guarded by _m
+			size_t _done = 0;
+			std::exception_ptr _error;
+			std::mutex _m;
+			std::condition_variable _cv;
+		};
+
+		/* Runs body on [0, n) with the threads of the pool, the calling thread
+		 * taking part in the work */
+		template <class Body>
+		void run_parallel(thread_pool &pool, size_t n, size_t grain,
+						  Body body) {
+			if (!n) return;
+			if (!grain) grain = 1;
+			size_t chunks = (n + grain - 1) / grain;
+			size_t workers = pool.size() + 1;
+			if (workers > chunks) workers = chunks;
+			auto s = std::make_shared<parallel_state>(n, grain, workers);
+			for (size_t i = 1; i < workers; ++i) {
+				// the chunks left over are done by the other threads
+				try {
+					pool.post([s, body]() mutable noexcept { s->work(body); });
+				} catch (...) {
+					break;
+				}
+			}
+			s->work(body);
+			s->wait();
+		}
+	} // namespace _details
+
+	/**
+	 * Invokes f on every index of [begin, end), using the threads of the pool
+	 * as well as the calling thread. The range is split in chunks, whose size
+	 * decreases from about (end - begin) / (2 * threads) down to grain
+	 * @tparam Index: An integer type
+	 * @param pool: The thread pool to use
+	 * @param begin: The first index
+	 * @param end: The index past the last one
+	 * @param grain: The minimum number of indices per chunk
+	 * @param f: The callable object to invoke, which may be called from
+	 * several threads at once
+	 * @note If f throws, the chunks which haven't started yet are cancelled,
+	 * and the first exception is rethrown once all threads are done
+	 */
+	template <class Index, class F>
+	void parallel_for(thread_pool &pool, Index begin,
+					  typename type_identity<Index>::type end, size_t grain,
+					  F &&f) {
+		static_assert(std::is_integral<Index>::value,
+					  "The indices must be integers");
+		if (!(begin < end)) return;
+		auto body = [begin, &f](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i)
+				f(Index(begin + i));
+		};
+		_details::run_parallel(pool, size_t(end - begin), grain, body);
+	}
+
+	/**
+	 * Combines init and all the elements of [first, last) with op, using the
+	 * threads of the pool as well as the calling thread. Each chunk is
+	 * reduced separately, and the partial results are then combined in an
+	 * unspecified order
+	 * @tparam It: A random access iterator type
+	 * @param pool: The thread pool to use
+	 * @param first: The beginning of the range
+	 * @param last: The end of the range
+	 * @param grain: The minimum number of elements per chunk
+	 * @param init: The initial value
+	 * @param op: The binary operation, which must be associative and
+	 * commutative, and may be called from several threads at once
+	 * @return The result of the reduction, or init if the range is empty
+	 * @note If op throws, the chunks which haven't started yet are
+	 * cancelled, and the first exception is rethrown once all threads are
+	 * done
+	 */
+	template <class It, class T, class Op>
+	[[nodiscard]]
+	T parallel_reduce(thread_pool &pool, It first, It last, size_t grain,
+					  T init, Op op) {
+		using _Diff = typename std::iterator_traits<It>::difference_type;
+		std::mutex m;
+		auto body = [first, &op, &init, &m](size_t lo, size_t hi) {
+			It it = first + _Diff(lo);
+			const It end = first + _Diff(hi);
+			T part = *it;
+			while (++it != end)
+				part = op(std::move(part), *it);
+			std::lock_guard<std::mutex> lk(m);
+			init = op(std::move(init), std::move(part));
+		};
+		_details::run_parallel(pool, size_t(last - first), grain, body);
+		return init;
+	}
+} // namespace libstra
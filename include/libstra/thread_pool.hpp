@@ -4,11 +4,62 @@
 #include <queue>
 #include <future>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
 #include <condition_variable>
 #include <libstra/unique_function.hpp>
+#include <libstra/functional.hpp>
+#include <libstra/mpmc_queue.hpp>
+#include <libstra/ws_deque.hpp>
 #include <libstra/utility.hpp>
 
 namespace libstra {
+	/**
+	 * The priority classes of thread_pool tasks. Each one has its own queue,
+	 * and the threads take the tasks of the highest priority first
+	 */
+	enum class task_priority {
+		high,
+		normal,
+		// Tasks which should only run when there is nothing else to do
+		background,
+	};
+
+	/**
+	 * Options controlling how a thread_pool queues and schedules its tasks
+	 */
+	struct thread_pool_options {
+		/**
+		 * If non-zero, the tasks are queued in a lock-free queue of that
+		 * capacity (rounded up to a power of 2) rather than in a queue guarded
+		 * by a mutex. Tasks which don't fit in it go to the guarded queue
+		 */
+		size_t lock_free_capacity = 0;
+		/**
+		 * If true, each thread has its own deque. Tasks submitted from one of
+		 * the threads go to its deque, which it pops in LIFO order, and idle
+		 * threads steal the oldest tasks of the others. Tasks submitted from
+		 * other threads still go to the shared queue
+		 */
+		bool work_stealing = false;
+		/**
+		 * Called with the exceptions thrown by the tasks submitted with post,
+		 * from the thread which ran the task. It may be called from several
+		 * threads at once, and must not throw. If empty, std::terminate is
+		 * called instead
+		 */
+		copyable_function<void(std::exception_ptr)> exception_handler;
+		/**
+		 * When tasks of different priorities are queued, every
+		 * starvation_limit-th task is taken from the lowest priority queue
+		 * which isn't empty, so that high priority tasks can't delay the others
+		 * indefinitely. If 0, the priorities are strict
+		 */
+		size_t starvation_limit = 16;
+	};
+
 	/**
 	 * Represents a pool of threads you can assign any kind of task to
 	 */
@@ -20,6 +71,13 @@ namespace libstra {
 		 * the behaviour is undefined
 		 */
 		thread_pool(size_t n);
+		/**
+		 * Constructs the pool with a fixed amount of threads
+		 * @param n: The number of threads to create. If 0,
+		 * the behaviour is undefined
+		 * @param opt: The options of the pool
+		 */
+		thread_pool(size_t n, const thread_pool_options &opt);
 		/**
 		 * Destroys the pool, by stopping all threads. May block
 		 * if some threads are actively executing a task, but any
@@ -35,34 +93,181 @@ namespace libstra {
 		 * @tparam R: The type of object returned by the task
 		 * @tparam F: A callable object type
 		 * @tparam Args: A list of argument types
-		 * @param f: The callable object to invoke
+		 * @param f: The callable object to invoke. It may be a pointer to
+		 * member, in which case the first argument is the object
 		 * @param Args: The arguments to pass to f
 		 * @returns A std::future object you can use to wait on the task,
 		 * and get its result or any exception that might have occurred
 		 * @note If the callable object takes arguments by reference, you
 		 * MUST wrap the references, using std::ref
 		 */
-		template <class R, class F, typename... Args>
+		template <class R, class F, typename... Args,
+				  typename = std::enable_if_t<
+					  !std::is_same<std::decay_t<F>, task_priority>::value>>
 		[[nodiscard]]
 		std::future<R> enqueue_task(F &&f, Args &&...args) {
+			return enqueue_task<R>(task_priority::normal,
+								   libstra::forward<F>(f),
+								   libstra::forward<Args>(args)...);
+		}
+		/**
+		 * Adds a new task to the queue of the given priority
+		 * @tparam R: The type of object returned by the task
+		 * @param prio: The priority of the task
+		 * @param f: The callable object to invoke. It may be a pointer to
+		 * member, in which case the first argument is the object
+		 * @param Args: The arguments to pass to f
+		 * @returns A std::future object you can use to wait on the task,
+		 * and get its result or any exception that might have occurred
+		 * @note If the callable object takes arguments by reference, you
+		 * MUST wrap the references, using std::ref
+		 */
+		template <class R, class F, typename... Args>
+		[[nodiscard]]
+		std::future<R> enqueue_task(task_priority prio, F &&f,
+									Args &&...args) {
 			std::promise<R> p;
 			auto res = p.get_future();
-			{
-				std::lock_guard<std::mutex> lk(_mutex);
-				auto &&task = make_task<R>(std::move(p), forward<F>(f),
-										   libstra::forward<Args>(args)...);
-				_tasks.emplace(std::move(task));
-				++_current_tasks;
-			}
-			_cv.notify_one();
+			push(make_task<R>(std::move(p), libstra::forward<F>(f),
+							  libstra::forward<Args>(args)...),
+				 prio);
 			return res;
 		}
 		/**
-		 * Waits for all current tasks to finish executing
-		 * @note If you want to wait for a specific task, use the wait method
-		 * on the std::future object associated with the task
+		 * Adds a new task to the queue, without any way to wait on it or to get
+		 * its result. This avoids the allocation of the shared state of a
+		 * std::future
+		 * @tparam F: A callable object type
+		 * @tparam Args: A list of argument types
+		 * @param f: The callable object to invoke. It may be a pointer to
+		 * member, in which case the first argument is the object. Its result
+		 * is discarded
+		 * @param Args: The arguments to pass to f
+		 * @note Any exception thrown by the task is passed to the
+		 * exception_handler of the pool's options
+		 * @note If the callable object takes arguments by reference, you
+		 * MUST wrap the references, using std::ref
+		 */
+		template <class F, typename... Args,
+				  typename = std::enable_if_t<
+					  !std::is_same<std::decay_t<F>, task_priority>::value>>
+		void post(F &&f, Args &&...args) {
+			post(task_priority::normal, libstra::forward<F>(f),
+				 libstra::forward<Args>(args)...);
+		}
+		/**
+		 * Same as post(f, args...), with the given priority
+		 * @param prio: The priority of the task
+		 */
+		template <class F, typename... Args>
+		void post(task_priority prio, F &&f, Args &&...args) {
+			auto bound = libstra::bind_front(libstra::forward<F>(f),
+											 libstra::forward<Args>(args)...);
+			using _Nothrow =
+				std::integral_constant<bool, noexcept(std::move(bound)())>;
+			push(make_posted(_Nothrow{}, std::move(bound)), prio);
+		}
+		/**
+		 * Adds a range of tasks to the queue at once, as if each of them was
+		 * passed to post. The queue is only locked once, and at most one
+		 * idle thread is woken up per task
+		 * @tparam It: An input iterator type, whose elements are callable
+		 * objects taking no arguments
+		 * @param first: The beginning of the range
+		 * @param last: The end of the range
+		 * @note The elements are copied, unless It is a std::move_iterator
+		 */
+		template <class It>
+		void enqueue_bulk(It first, It last) {
+			using _Fn = std::decay_t<decltype(*first)>;
+			using _Nothrow =
+				std::integral_constant<bool, noexcept(std::declval<_Fn>()())>;
+			std::vector<_task_t> tasks;
+			reserve_for(tasks, first, last,
+						typename std::iterator_traits<It>::iterator_category{});
+			for (; first != last; ++first)
+				tasks.emplace_back(make_posted(_Nothrow{}, _Fn(*first)));
+			push_bulk(tasks.data(), tasks.size());
+		}
+#if LIBSTRA_HAS_COROUTINES
+		/**
+		 * Adds a coroutine to the queue, to be resumed by one of the threads.
+		 * The handle is stored in the task itself, so this doesn't allocate,
+		 * except for the first tasks of a thread in work stealing mode, which
+		 * allocate the boxes the next ones reuse
+		 * @param h: The handle of the suspended coroutine to resume
+		 * @note Defined inline, as the library itself may be compiled with an
+		 * older standard
+		 */
+		void enqueue(std::coroutine_handle<> h) { push(_task_t(h)); }
+
+		/** Awaitable object which resumes the awaiting coroutine on the pool */
+		struct schedule_awaiter {
+			thread_pool *pool;
+
+			constexpr bool await_ready() const noexcept { return false; }
+			void await_suspend(std::coroutine_handle<> h) { pool->enqueue(h); }
+			constexpr void await_resume() const noexcept {}
+		};
+		/**
+		 * Moves the calling coroutine to the pool: co_await pool.schedule()
+		 * suspends it, and resumes it on one of the threads
+		 */
+		[[nodiscard]]
+		schedule_awaiter schedule() noexcept {
+			return { this };
+		}
+#endif
+		/**
+		 * @return The number of queued tasks of the given priority. This is
+		 * only an estimate if tasks are being queued or taken concurrently
+		 */
+		[[nodiscard]]
+		size_t depth(task_priority prio) const noexcept {
+			if (prio != task_priority::normal)
+				return _depth[size_t(prio)].load(std::memory_order_relaxed);
+			size_t others =
+				_depth[size_t(task_priority::high)].load(
+					std::memory_order_relaxed) +
+				_depth[size_t(task_priority::background)].load(
+					std::memory_order_relaxed);
+			size_t queued = _queued.load(std::memory_order_relaxed);
+			return queued > others ? queued - others : 0;
+		}
+		/** @return The number of threads of the pool */
+		[[nodiscard]]
+		size_t size() const noexcept {
+			return _threads.size();
+		}
+		/**
+		 * Waits for all current tasks to finish executing. The calling thread
+		 * runs queued tasks in the meantime
+		 * @note When called from one of the pool's tasks, this doesn't wait
+		 * for the tasks which are themselves in wait, including the caller
+		 * @note If you want to wait for a specific task, use wait_for
 		 */
 		void wait();
+		/**
+		 * Waits for a future to be ready, running queued tasks in the
+		 * meantime. Unlike f.wait(), this can be called from one of the pool's
+		 * tasks without the risk of a deadlock
+		 * @tparam Future: std::future, or any type with the same wait_for and
+		 * wait member functions
+		 * @param f: The future to wait on, typically returned by enqueue_task
+		 * @note The future is checked every time a task finishes, and every
+		 * millisecond while there is nothing to run, in case it is made ready
+		 * outside of the pool
+		 */
+		template <class Future>
+		void wait_for(const Future &f) {
+			help_until(
+				[&f]() {
+					return f.wait_for(std::chrono::seconds(0)) !=
+						   std::future_status::timeout;
+				},
+				true);
+			f.wait();
+		}
 		/**
 		 * Waits for all current tasks to finish, then stops and joins all the
 		 * threads
@@ -77,47 +282,159 @@ namespace libstra {
 		void restart();
 
 	private:
-		void thread_loop();
+		/* Large enough to hold the promise, a function pointer and a couple of
+		 * arguments without allocating. Tasks catch their own exceptions, so
+		 * they are never expected to throw, but the signature isn't noexcept:
+		 * it appears in functions defined in the library, which must be the
+		 * same whatever the standard the library and its users are built
+		 * with */
+		using _task_t = basic_unique_function<void(), 6 * sizeof(void *)>;
+
+		void thread_loop(size_t index);
 		void join_threads();
+		// Queues a task, and wakes up a thread if any is idle
+		void push(_task_t &&task, task_priority prio = task_priority::normal);
+		// Queues n tasks under a single lock
+		void push_bulk(_task_t *tasks, size_t n);
+		// Takes the next task out of the queues, if any
+		bool try_pop(_task_t &task);
+		// Takes a task out of the guarded queue of a lane
+		bool pop_lane(size_t lane, _task_t &task);
+		// Takes a normal priority task, from any of the queues holding them
+		bool pop_normal(_task_t &task);
+		// Updates the counters once n tasks have been queued in a lane
+		void pushed(size_t lane, size_t n) noexcept;
+		// Updates the counters once n tasks have been taken out of a lane
+		void popped(size_t lane, size_t n = 1) noexcept;
+		// Takes a task from the deque of another thread
+		bool steal(_task_t &task);
+		// Boxes a task for the deque of the current thread
+		std::unique_ptr<_task_t> box(_task_t &&task);
+		// Takes a task out of its box, which is kept for the next ones
+		void unbox(_task_t *p, _task_t &task) noexcept;
+		// Takes the next task and runs it, returns false if there was none
+		bool run_one();
+		// Called when a task is done, or was never queued
+		void finish_task();
+		/* Runs queued tasks until done returns true, or the pool is stopped.
+		 * If poll is true, done may become true without the pool being
+		 * notified, so it is checked periodically while the thread blocks */
+		void help_until(function_ref<bool()> done, bool poll = false);
+		// Passes the exception of a posted task to the handler
+		void on_exception(std::exception_ptr e) noexcept;
+
+		template <class R, class F>
+		static void set_result(std::promise<R> &p, F &f) {
+			p.set_value(std::move(f)());
+		}
+		template <class F>
+		static void set_result(std::promise<void> &p, F &f) {
+			std::move(f)();
+			p.set_value();
+		}
+		// Tasks which can't throw don't need to catch anything
+		template <class R, class F>
+		static void run_task(std::true_type, std::promise<R> &p,
+							 F &f) noexcept {
+			set_result(p, f);
+		}
+		template <class R, class F>
+		static void run_task(std::false_type, std::promise<R> &p,
+							 F &f) noexcept {
+			try {
+				set_result(p, f);
+			} catch (...) {
+				p.set_exception(std::current_exception());
+			}
+		}
 
-		template <class R, class F,
-				  std::enable_if_t<!std::is_void<R>::value, int> = 0,
-				  typename... Args>
+		template <class R, class F, typename... Args>
 		auto make_task(std::promise<R> &&p, F &&f, Args &&...args) {
-			std::tuple<std::decay_t<Args>...> t{ libstra::forward<Args>(
-				args)... }; // store the values
-			return [p = std::move(p), f = forward<F>(f),
-					args = std::move(t)]() mutable {
-				try {
-					p.set_value(libstra::apply(std::move(f), std::move(args)));
-				} catch (...) {
-					p.set_exception(std::current_exception());
-				}
+			// store the values, without using any space for empty objects
+			auto bound = libstra::bind_front(libstra::forward<F>(f),
+											 libstra::forward<Args>(args)...);
+			using _Nothrow = std::integral_constant<
+				bool, noexcept(std::move(bound)()) &&
+						  (std::is_void<R>::value ||
+						   std::is_nothrow_move_constructible<R>::value)>;
+			return [p = std::move(p),
+					f = std::move(bound)]() mutable noexcept {
+				run_task(_Nothrow{}, p, f);
 			};
 		}
-		template <class R, class F,
-				  std::enable_if_t<std::is_void<R>::value, int> = 0,
-				  typename... Args>
-		auto make_task(std::promise<R> &&p, F &&f, Args &&...args) {
-			std::tuple<std::decay_t<Args>...> t{ libstra::forward<Args>(
-				args)... }; // store the values
-			return [p = std::move(p), f = forward<F>(f),
-					args = std::move(t)]() mutable {
-				try {
-					libstra::apply(std::move(f), std::move(args));
-					p.set_value();
 
+		template <class It>
+		static void reserve_for(std::vector<_task_t> &v, It first, It last,
+								std::forward_iterator_tag) {
+			v.reserve(std::distance(first, last));
+		}
+		template <class It>
+		static void reserve_for(std::vector<_task_t> &, It, It,
+								std::input_iterator_tag) {}
+
+		template <class F>
+		auto make_posted(std::true_type, F &&f) {
+			return [f = std::move(f)]() mutable noexcept { std::move(f)(); };
+		}
+		template <class F>
+		auto make_posted(std::false_type, F &&f) {
+			return [this, f = std::move(f)]() mutable noexcept {
+				try {
+					std::move(f)();
 				} catch (...) {
-					p.set_exception(std::current_exception());
+					on_exception(std::current_exception());
 				}
 			};
 		}
 
 		std::vector<std::thread> _threads;
-		std::condition_variable _cv;
-		std::queue<unique_function<void()>> _tasks;
+		// Idle threads wait on _cv, threads waiting for the tasks to finish
+		// wait on _done_cv
+		std::condition_variable _cv, _done_cv;
+		static constexpr size_t _lane_count = 3;
+		// The queue of each priority, guarded by _mutex
+		std::queue<_task_t> _tasks[_lane_count];
+		std::unique_ptr<mpmc_queue<_task_t>> _lf_tasks;
+		/* The state of each thread, in work stealing mode. The tasks are
+		 * boxed, as the deques need trivially copyable elements. The boxes
+		 * are reused, so that queuing a task doesn't allocate: each thread
+		 * keeps up to _spare_boxes of the ones it empties, and only deletes
+		 * the others */
+		struct _worker {
+			_worker() { spare.reserve(_spare_boxes); }
+
+			ws_deque<_task_t *> deque;
+			std::vector<std::unique_ptr<_task_t>> spare;
+		};
+		static constexpr size_t _spare_boxes = 64;
+		std::vector<std::unique_ptr<_worker>> _workers;
 		std::mutex _mutex, _stopMutex;
-		size_t _current_tasks = 0;
-		bool _stopped = false;
+		/* The counters are kept on separate cache lines, depending on when
+		 * they are written: when a task is queued or taken, when it is done,
+		 * or only when threads block and wake up. The ones which are only
+		 * read when queuing tasks are then not invalidated by the others */
+		char _pad0[_details::cache_line_size];
+		// The number of tasks in the queues
+		std::atomic<size_t> _queued{ 0 };
+		// The number of tasks of the high and background priorities in the
+		// queues. The normal ones are the rest, so they aren't counted
+		std::atomic<size_t> _depth[_lane_count] = {};
+		char _pad1[_details::cache_line_size];
+		// The number of tasks which are either queued or running
+		std::atomic<size_t> _unfinished{ 0 };
+		char _pad2[_details::cache_line_size];
+		// Counts the tasks taken while several priorities are queued
+		std::atomic<size_t> _turn{ 0 };
+		char _pad3[_details::cache_line_size];
+		// The number of threads waiting on _cv
+		std::atomic<size_t> _idle{ 0 };
+		// The number of threads waiting on _done_cv
+		std::atomic<size_t> _waiting{ 0 };
+		// The number of tasks calling wait
+		std::atomic<size_t> _nested{ 0 };
+		std::atomic<bool> _stopped{ false };
+		char _pad4[_details::cache_line_size];
+		const size_t _starvation_limit;
+		copyable_function<void(std::exception_ptr)> _exception_handler;
 	};
 } // namespace libstra
@@ -3,9 +3,20 @@
 
 #include <type_traits>
 #include <utility>
+#include "internal/config.h"
+#if LIBSTRA_HAS_RTTI
 #include <typeinfo>
+#endif
+#include <new>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
 #include <libstra/utility.hpp>
 #include "internal/attrib_macros.h"
+#if LIBSTRA_HAS_COROUTINES
+#include <coroutine>
+#endif
 
 namespace libstra {
 
@@ -26,15 +37,461 @@ namespace libstra {
 		}
 	};
 
+	/**
+	 * Tag type used to request that a copyable function object shares its
+	 * target between copies, instead of copying it
+	 */
+	struct shared_target_t {};
+
+	/**
+	 * Lists the signatures of a type-erased function object which can be
+	 * called in several ways, e.g. basic_unique_function<overloads<void(int),
+	 * void(const char *)>>. The target is stored once, and the operations
+	 * table holds one entry per signature
+	 */
+	template <class... Sigs>
+	struct overloads {};
+
+#if LIBSTRA_FUNCTION_STATS
+	/**
+	 * Counters recording how the targets of the type-erased function objects
+	 * are stored, when they are constructed from a callable object. Only
+	 * available if LIBSTRA_FUNCTION_STATS is defined to 1
+	 */
+	struct function_stats {
+		// The number of targets stored in the inline buffer
+		std::atomic<size_t> inline_count{ 0 };
+		// The number of targets stored on the heap, and the total number of
+		// bytes allocated for them
+		std::atomic<size_t> heap_count{ 0 };
+		std::atomic<size_t> heap_bytes{ 0 };
+		/**
+		 * If not null, called every time a target is stored on the heap, with
+		 * the name of its type (null without RTTI) and the number of bytes
+		 * allocated
+		 */
+		std::atomic<void (*)(const char *type_name, size_t bytes)> heap_hook{
+			nullptr
+		};
+
+		// Sets all the counters back to 0
+		void reset() noexcept {
+			inline_count = 0;
+			heap_count = 0;
+			heap_bytes = 0;
+		}
+	};
+
+	/** @return The global counters of the type-erased function objects */
+	inline function_stats &get_function_stats() noexcept {
+		static function_stats stats;
+		return stats;
+	}
+
+	namespace _details {
+		template <class T>
+		void record_construction(size_t heap_bytes) noexcept {
+			function_stats &stats = get_function_stats();
+			if (!heap_bytes) {
+				stats.inline_count.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			stats.heap_count.fetch_add(1, std::memory_order_relaxed);
+			stats.heap_bytes.fetch_add(heap_bytes, std::memory_order_relaxed);
+			if (auto hook = stats.heap_hook.load(std::memory_order_relaxed)) {
+#if LIBSTRA_HAS_RTTI
+				hook(typeid(T).name(), heap_bytes);
+#else
+				hook(nullptr, heap_bytes);
+#endif
+			}
+		}
+	} // namespace _details
+#endif
+
+	namespace _details {
+		template <class T>
+		struct type_tag {
+			static constexpr char id = 0;
+		};
+		template <class T>
+		constexpr char type_tag<T>::id;
+
+		/**
+		 * @return A value which uniquely identifies the type T, which doesn't
+		 * require RTTI
+		 */
+		template <class T>
+		constexpr const void *type_id() noexcept {
+			return &type_tag<T>::id;
+		}
+
+#if LIBSTRA_HAS_RTTI
+		/**
+		 * Associates the trampoline function_ref calls a type of object
+		 * through with that type, so that function_ref doesn't need to store
+		 * it. The instances add themselves to a global list when they are
+		 * constructed, during static initialization
+		 */
+		class ref_target {
+		public:
+			ref_target(void (*invoke)(), const std::type_info &type) noexcept;
+			ref_target(const ref_target &) = delete;
+
+			/**
+			 * @return The type registered with the trampoline, or
+			 * typeid(void) if there is none
+			 */
+			static const std::type_info &find(void (*invoke)()) noexcept;
+
+		private:
+			void (*const _invoke)();
+			const std::type_info &_type;
+			const ref_target *_next;
+		};
+#endif
+
+		/**
+		 * The type used to pass an argument of type T through a type-erased
+		 * call. Trivially copyable objects up to two words are passed by
+		 * value, so that they stay in registers across the indirect call.
+		 * Other objects are passed by reference
+		 */
+		template <class T>
+		using param_t = std::conditional_t<
+			!std::is_reference<T>::value && std::is_trivially_copyable<T>::value &&
+				sizeof(T) <= 2 * sizeof(void *),
+			T, T &&>;
+
+		// Function pointers are identified by the type of function they point
+		// to
+		template <class T>
+		using target_type_t =
+			std::conditional_t<is_function_ptr_v<T>, std::remove_pointer_t<T>,
+							   T>;
+
+		template <class Sig>
+		struct sig_traits;
+
+		// The signature of a function object callable through Sigs
+		template <class Sig, class... Sigs>
+		struct overload_set {
+			using type = overloads<Sig, Sigs...>;
+		};
+		template <class Sig>
+		struct overload_set<Sig> {
+			using type = Sig;
+		};
+
+		/**
+		 * Whether F is a coroutine handle, which is treated as a callable
+		 * object resuming the coroutine. Resuming never throws unless the
+		 * promise rethrows from unhandled_exception, so a handle is accepted
+		 * by noexcept signatures
+		 */
+		template <class F>
+		struct is_coroutine_handle : std::false_type {};
+#if LIBSTRA_HAS_COROUTINES
+		template <class P>
+		struct is_coroutine_handle<std::coroutine_handle<P>> : std::true_type {
+		};
+#endif
+
+		template <bool... B>
+		struct bool_list {};
+		// true if all of B are true
+		template <bool... B>
+		static constexpr bool all_v =
+			std::is_same<bool_list<true, B...>, bool_list<B..., true>>::value;
+
+		// The entry of an operations table which calls the target with
+		// arguments Args
+		template <class R, typename... Args>
+		struct fn_invoker {
+			R (*invoke)(void *mem, param_t<Args>... args);
+		};
+
+		/**
+		 * The entries of an operations table which don't depend on the
+		 * signature the target is called through
+		 */
+		struct erased_ops {
+			void (*destroy)(void *mem);
+			// Moves the object from src to dst, and ends the lifetime of src.
+			// Null if this can be done by copying the bytes of the storage
+			void (*relocate)(void *dst, void *src);
+			// Returns the address of the object
+			void *(*get)(void *mem);
+			const void *id;
+#if LIBSTRA_HAS_RTTI
+			const std::type_info *type;
+#endif
+
+			template <class Store, class T>
+			static constexpr erased_ops make() noexcept {
+				return {
+					&Store::destroy,
+					Store::trivially_relocatable ? nullptr : &Store::relocate,
+					&get_object<Store>,
+					type_id<target_type_t<T>>(),
+#if LIBSTRA_HAS_RTTI
+					&typeid(target_type_t<T>),
+#endif
+				};
+			}
+			template <class Store>
+			static void *get_object(void *mem) noexcept {
+				return (void *)Store::get(mem);
+			}
+		};
+
+		/**
+		 * Operations table shared by all type-erased function objects holding
+		 * the same type of callable, stored the same way
+		 */
+		template <class R, typename... Args>
+		struct fn_ops : fn_invoker<R, Args...>, erased_ops {
+			constexpr fn_ops(fn_invoker<R, Args...> inv,
+							 erased_ops ops) noexcept :
+				fn_invoker<R, Args...>(inv), erased_ops(ops) {}
+
+			/**
+			 * @return The operations for objects of type T, stored as
+			 * described by Store, called through signature Sig
+			 */
+			template <class Store, class T, class Sig>
+			static constexpr fn_ops make() noexcept {
+				return { { &sig_traits<Sig>::template invoke<Store> },
+						 erased_ops::make<Store, T>() };
+			}
+		};
+
+		/**
+		 * Operations table of the function objects with several signatures,
+		 * which holds one invoker per signature
+		 */
+		template <class... Sigs>
+		struct overload_ops : sig_traits<Sigs>::invoker_type..., erased_ops {
+			constexpr overload_ops(
+				erased_ops ops,
+				typename sig_traits<Sigs>::invoker_type... inv) noexcept :
+				sig_traits<Sigs>::invoker_type(inv)..., erased_ops(ops) {}
+
+			template <class Store, class T, class Sig>
+			static constexpr overload_ops make() noexcept {
+				return { erased_ops::make<Store, T>(),
+						 { &sig_traits<Sigs>::template invoke<Store> }... };
+			}
+		};
+
+		template <class T>
+		struct erased_shared_storage;
+
+		/**
+		 * Operations table of the copyable function objects, which adds the
+		 * copy operation to Base
+		 */
+		template <class Base>
+		struct copyable_ops : Base {
+			// Constructs a copy of the object held in src, into dst
+			void (*copy)(void *dst, const void *src);
+			// Whether the copies share the object instead
+			bool shared;
+
+			constexpr copyable_ops(const Base &base,
+								   void (*c)(void *, const void *),
+								   bool s) noexcept :
+				Base(base),
+				copy(c), shared(s) {}
+
+			template <class Store, class T, class Sig>
+			static constexpr copyable_ops make() noexcept {
+				return { Base::template make<Store, T, Sig>(), &Store::copy,
+						 std::is_same<Store, erased_shared_storage<T>>::value };
+			}
+		};
+
+		/**
+		 * Describes how an object of type T is laid out in the storage of a
+		 * type-erased function object
+		 * @tparam Inline: Whether T lives in the storage itself, or on the
+		 * heap with the storage holding a pointer to it
+		 */
+		template <class T, bool Inline>
+		struct erased_storage;
+
+		template <class T>
+		struct erased_storage<T, true> {
+			static constexpr bool trivially_relocatable =
+				is_trivially_relocatable_v<T>;
+			// The number of bytes allocated on the heap
+			static constexpr size_t heap_bytes = 0;
+			template <class U>
+			static void create(void *mem, U &&x) {
+				new (mem) T(libstra::forward<U>(x));
+			}
+			static T *get(void *mem) noexcept { return (T *)mem; }
+			static void destroy(void *mem) noexcept { get(mem)->~T(); }
+			static void relocate(void *dst, void *src) noexcept {
+				new (dst) T(std::move(*get(src)));
+				destroy(src);
+			}
+			static void copy(void *dst, const void *src) {
+				new (dst) T(*get((void *)src));
+#if LIBSTRA_FUNCTION_STATS
+				record_construction<T>(heap_bytes);
+#endif
+			}
+		};
+		template <class T>
+		struct erased_storage<T, false> {
+			// Only the pointer to the object is stored
+			static constexpr bool trivially_relocatable = true;
+			static constexpr size_t heap_bytes = sizeof(T);
+			template <class U>
+			static void create(void *mem, U &&x) {
+				*(T **)mem = new T(libstra::forward<U>(x));
+			}
+			static T *get(void *mem) noexcept { return *(T **)mem; }
+			static void destroy(void *mem) noexcept { delete get(mem); }
+			static void relocate(void *dst, void *src) noexcept {
+				*(T **)dst = get(src);
+			}
+			static void copy(void *dst, const void *src) {
+				*(T **)dst = new T(*get((void *)src));
+#if LIBSTRA_FUNCTION_STATS
+				record_construction<T>(heap_bytes);
+#endif
+			}
+		};
+
+		/**
+		 * Heap storage where the object is allocated with an allocator. The
+		 * storage holds a pointer to a block holding the object, and a copy
+		 * of the allocator used to release the memory
+		 */
+		template <class T, class Alloc>
+		struct erased_alloc_storage {
+			struct block {
+				T obj;
+				typename std::allocator_traits<Alloc>::template rebind_alloc<
+					block>
+					alloc;
+
+				template <class U, class A>
+				block(U &&x, const A &a) :
+					obj(libstra::forward<U>(x)), alloc(a) {}
+			};
+			using alloc_t = decltype(block::alloc);
+			using traits = std::allocator_traits<alloc_t>;
+
+			static constexpr bool trivially_relocatable = true;
+			static constexpr size_t heap_bytes = sizeof(block);
+			template <class U>
+			static void create(void *mem, const Alloc &a, U &&x) {
+				alloc_t al(a);
+				block *b = traits::allocate(al, 1);
+				try {
+					new (b) block(libstra::forward<U>(x), al);
+				} catch (...) {
+					traits::deallocate(al, b, 1);
+					throw;
+				}
+				*(block **)mem = b;
+			}
+			static T *get(void *mem) noexcept { return &(*(block **)mem)->obj; }
+			static void destroy(void *mem) noexcept {
+				block *b = *(block **)mem;
+				alloc_t al(std::move(b->alloc));
+				b->~block();
+				traits::deallocate(al, b, 1);
+			}
+			static void relocate(void *dst, void *src) noexcept {
+				*(block **)dst = *(block **)src;
+			}
+		};
+
+		/**
+		 * Heap storage where the object is shared between all the copies of
+		 * the function object, and destroyed along with the last of them. The
+		 * storage holds a pointer to a block holding the object and the
+		 * reference count. The object is only ever accessed as const
+		 */
+		template <class T>
+		struct erased_shared_storage {
+			struct block {
+				T obj;
+				std::atomic<size_t> refs;
+
+				template <class U>
+				block(U &&x) : obj(libstra::forward<U>(x)), refs(1) {}
+			};
+
+			static constexpr bool trivially_relocatable = true;
+			static constexpr size_t heap_bytes = sizeof(block);
+			template <class U>
+			static void create(void *mem, U &&x) {
+				*(block **)mem = new block(libstra::forward<U>(x));
+			}
+			static const T *get(void *mem) noexcept {
+				return &(*(block **)mem)->obj;
+			}
+			static void destroy(void *mem) noexcept {
+				block *b = *(block **)mem;
+				if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					delete b;
+			}
+			static void relocate(void *dst, void *src) noexcept {
+				*(block **)dst = *(block **)src;
+			}
+			static void copy(void *dst, const void *src) noexcept {
+				block *b = *(block *const *)src;
+				b->refs.fetch_add(1, std::memory_order_relaxed);
+				*(block **)dst = b;
+			}
+		};
+
+		/**
+		 * @return The operations table for callable objects of type T, stored
+		 * as described by Store, called through signature Sig
+		 * @tparam Ops: The type of operations table
+		 */
+		template <class Store, class T, class Sig,
+				  class Ops = typename sig_traits<Sig>::ops_type>
+		const Ops *get_fn_ops() noexcept {
+			static constexpr Ops ops = Ops::template make<Store, T, Sig>();
+			return &ops;
+		}
+	} // namespace _details
+
+	/**
+	 * Represents a generic non-copyable callable object. Callable objects
+	 * which fit in the inline buffer are stored in place, others are allocated
+	 * on the heap
+	 * @tparam Func: The underlying function type. It may be const-qualified,
+	 * in which case the target is called as a const object, and since C++17
+	 * noexcept-qualified, in which case only targets which don't throw are
+	 * accepted. It may also be an overloads<...> list of function types
+	 * @tparam InlineBytes: The size of the inline buffer, in bytes
+	 * @tparam Align: The alignment of the inline buffer. Callable objects with
+	 * a stricter alignment requirement are always allocated on the heap
+	 */
+	template <class Func, size_t InlineBytes = 2 * sizeof(void *),
+			  size_t Align = alignof(void *)>
+	class basic_unique_function;
+
 	/**
 	 * Represents a generic non-copyable callable object
-	 * @tparam Func: The underlying function type
+	 * @tparam Func: The underlying function type. If several function types
+	 * are given, the object has one call operator for each of them
 	 */
-	template <class Func>
-	class unique_function;
+	template <class Func, class... Funcs>
+	using unique_function = basic_unique_function<
+		typename _details::overload_set<Func, Funcs...>::type>;
 
 	/**
-	 * Represents a reference to a generic callable object
+	 * Represents a reference to a generic callable object. It is two pointers
+	 * wide and trivially copyable, and meant to be passed by value
 	 * @tparam Func: The underlying function type
 	 * @warning If the referenced object reaches its end of life before the
 	 * reference, the reference will become dangling
@@ -47,49 +504,51 @@ namespace libstra {
 	public:
 		/** Constructs an empty function_ref */
 		constexpr function_ref() noexcept = default;
-		/** Constructs the reference from a function pointer */
-		function_ref(R (*f)(Args...)) noexcept : _ptr((void *)f) {
-			using F = decltype(f);
-			_type_info = []() -> const std::type_info & {
-				return typeid(R(Args...));
-			};
-			_invoke = [](void *f, Args &&...args) {
-				return ((F)f)(forward<Args>(args)...);
-			};
-		}
-		function_ref(const function_ref &) = default;
+		/** Constructs the reference from a function pointer. If f is null,
+		 * the reference is empty */
+		constexpr function_ref(R (*f)(Args...)) noexcept :
+			_bound(f), _invoke(f ? &invoke_fn : nullptr) {}
+		constexpr function_ref(const function_ref &) noexcept = default;
 		/** Constructs the reference from a generic callable object */
 		template <class Func,
 				  typename = std::enable_if_t<
 					  !std::is_same<std::decay_t<Func>, function_ref>::value &&
 					  is_invocable_v<Func, Args...>>>
-		function_ref(Func &&f) noexcept {
-			using _Raw_t = std::remove_reference_t<Func>;
-			_ptr = &f;
-			_type_info = []() -> const std::type_info & {
-				return typeid(_Raw_t);
-			};
-			_invoke = [](void *f, Args &&...args) {
-				return (*(_Raw_t *)f)(forward<Args>(args)...);
-			};
+		constexpr function_ref(Func &&f) noexcept :
+			_bound(libstra::addressof(f)),
+			_invoke(&invoke_obj<std::remove_reference_t<Func>>) {
+#if LIBSTRA_HAS_RTTI
+			(void)&target_info<std::remove_reference_t<Func>>;
+#endif
 		}
+
+		constexpr function_ref &
+		operator=(const function_ref &) noexcept = default;
+
 		/**
-		 * @return typeid(T) if the target function has type T, otherwise
-		 * typeid(void)
+		 * @return The pointer to the target object if it has type T, otherwise
+		 * nullptr. If T is a function type, returns the referenced function
+		 * pointer if it has type T *
 		 */
+		template <class T>
 		[[nodiscard]]
-		const std::type_info &target_type() const noexcept {
-			return _type_info();
+		T *target() const noexcept {
+			return target_ptr<T>(std::is_function<T>{});
 		}
+#if LIBSTRA_HAS_RTTI
 		/**
-		 * @return The pointer to the target object if target_type() ==
-		 * typeid(T), otherwise nullptr
+		 * @return typeid(T) if the target function has type T, otherwise
+		 * typeid(void)
+		 * @note Only available if RTTI is enabled
 		 */
-		template <class T>
 		[[nodiscard]]
-		T *target() noexcept {
-			return typeid(T) == _type_info() ? (T *)_ptr : nullptr;
+		const std::type_info &target_type() const noexcept {
+			if (!_invoke) return typeid(void);
+			if (_invoke == &invoke_fn) return typeid(R(Args...));
+			return _details::ref_target::find(
+				reinterpret_cast<void (*)()>(_invoke));
 		}
+#endif
 
 		/**
 		 * Attempts to invoke the function
@@ -98,15 +557,15 @@ namespace libstra {
 		 * @throw Throws invalid_function_access if *this does not contain a
 		 * valid callable object, that is if has_value() returns false
 		 */
-		R operator()(Args &&...args) {
-			if (!_ptr) throw invalid_function_access{};
-			return _invoke(_ptr, forward<Args>(args)...);
+		R operator()(_details::param_t<Args>... args) const {
+			if (!_invoke) throw invalid_function_access{};
+			return _invoke(_bound, libstra::forward<Args>(args)...);
 		}
 
 		/** @return true if *this is not empty, false otherwise */
 		[[nodiscard]]
 		inline constexpr bool has_value() const noexcept {
-			return (bool)_ptr;
+			return (bool)_invoke;
 		}
 		/** @return true if *this is not empty, false otherwise */
 		[[nodiscard]] inline constexpr operator bool() const noexcept {
@@ -114,203 +573,775 @@ namespace libstra {
 		}
 
 	private:
-		void *_ptr = nullptr;
-		R (*_invoke)(void *, Args &&...) = nullptr;
-		const std::type_info &(*_type_info)() = []() -> const std::type_info & {
-			return typeid(void);
+		// Either the address of the referenced object, or the function pointer
+		union bound_t {
+			const void *obj;
+			R (*fn)(Args...);
+
+			constexpr bound_t() noexcept : obj(nullptr) {}
+			constexpr bound_t(const void *p) noexcept : obj(p) {}
+			constexpr bound_t(R (*f)(Args...)) noexcept : fn(f) {}
 		};
-	};
 
+		template <class T>
+		static R invoke_obj(bound_t b, _details::param_t<Args>... args) {
+			return (*(T *)b.obj)(libstra::forward<Args>(args)...);
+		}
+		static R invoke_fn(bound_t b, _details::param_t<Args>... args) {
+			return b.fn(libstra::forward<Args>(args)...);
+		}
+
+		// Each type of target has its own trampoline, which identifies it
+		template <class T>
+		T *target_ptr(std::false_type) const noexcept {
+			if (_invoke == &invoke_obj<T> || _invoke == &invoke_obj<const T>)
+				return (T *)_bound.obj;
+			return nullptr;
+		}
+		template <class T>
+		T *target_ptr(std::true_type) const noexcept {
+			// only reached with T = R(Args...), through void (*)() so that
+			// other instantiations don't cast between function types
+			if (std::is_same<T, R(Args...)>::value && _invoke == &invoke_fn)
+				return reinterpret_cast<T *>(
+					reinterpret_cast<void (*)()>(_bound.fn));
+			return nullptr;
+		}
+
+#if LIBSTRA_HAS_RTTI
+		// Registers the type of the targets called by invoke_obj<T>
+		template <class T>
+		static const _details::ref_target target_info;
+#endif
+
+		bound_t _bound;
+		R (*_invoke)(bound_t, _details::param_t<Args>...) = nullptr;
+	};
+#if LIBSTRA_HAS_RTTI
 	template <class R, typename... Args>
-	class unique_function<R(Args...)> {
-	public:
-		/* Default constructor: constructs an invalid function object */
-		constexpr unique_function() noexcept = default;
+	template <class T>
+	const _details::ref_target function_ref<R(Args...)>::target_info(
+		reinterpret_cast<void (*)()>(&invoke_obj<T>), typeid(T));
+#endif
 
+	namespace _details {
 		/**
-		 * Contructs a unique_function instance from a function pointer
+		 * Describes how a type-erased function object with signature Sig calls
+		 * its target. Specialized for each combination of the const and
+		 * noexcept qualifiers
 		 */
-		unique_function(R (*f)(Args...)) noexcept : _ptr((void *)f) {
-			_mem[sizeof(_mem) - 1] = 1;
-			using F = R (*)(Args...);
-			_tid = &typeid(R(Args...));
-			_invoke = [](void *f, Args &&...args) {
-				return (*(F *)f)(forward<Args>(args)...);
-			};
+		template <class R, typename... Args>
+		struct sig_traits<R(Args...)> {
+			using result_type = R;
+			using function_type = R(Args...);
+			using ops_type = fn_ops<R, Args...>;
+			using invoker_type = fn_invoker<R, Args...>;
+
+			// Whether an object of type F can be stored and called
+			template <class F>
+			static constexpr bool accepts =
+				is_invocable_v<std::decay_t<F> &, Args...>;
+			// Whether an object of type F can be called as a const object
+			template <class F>
+			static constexpr bool accepts_const =
+				is_invocable_v<const std::decay_t<F> &, Args...>;
+
+			template <class Store>
+			static R invoke(void *mem, param_t<Args>... args) {
+				return (*Store::get(mem))(libstra::forward<Args>(args)...);
+			}
+		};
+		template <class R, typename... Args>
+		struct sig_traits<R(Args...) const> : sig_traits<R(Args...)> {
+			template <class F>
+			static constexpr bool accepts =
+				is_invocable_v<const std::decay_t<F> &, Args...>;
+
+			template <class Store>
+			static R invoke(void *mem, param_t<Args>... args) {
+				const auto &f = *Store::get(mem);
+				return f(libstra::forward<Args>(args)...);
+			}
+		};
+#if __cpp_noexcept_function_type
+		template <class R, typename... Args>
+		struct sig_traits<R(Args...) noexcept> : sig_traits<R(Args...)> {
+			template <class F>
+			static constexpr bool accepts =
+				is_nothrow_invocable_v<std::decay_t<F> &, Args...> ||
+				(is_coroutine_handle<std::decay_t<F>>::value &&
+				 std::is_void<R>::value && !sizeof...(Args));
+
+			template <class Store>
+			static R invoke(void *mem, param_t<Args>... args) noexcept {
+				return (*Store::get(mem))(libstra::forward<Args>(args)...);
+			}
+		};
+		template <class R, typename... Args>
+		struct sig_traits<R(Args...) const noexcept> : sig_traits<R(Args...)> {
+			template <class F>
+			static constexpr bool accepts =
+				is_nothrow_invocable_v<const std::decay_t<F> &, Args...> ||
+				(is_coroutine_handle<std::decay_t<F>>::value &&
+				 std::is_void<R>::value && !sizeof...(Args));
+
+			template <class Store>
+			static R invoke(void *mem, param_t<Args>... args) noexcept {
+				const auto &f = *Store::get(mem);
+				return f(libstra::forward<Args>(args)...);
+			}
+		};
+#endif
+		template <class Sig, class... Sigs>
+		struct sig_traits<overloads<Sig, Sigs...>> {
+			// get_ref refers to the target through the first signature
+			using function_type = typename sig_traits<Sig>::function_type;
+			using ops_type = overload_ops<Sig, Sigs...>;
+
+			template <class F>
+			static constexpr bool accepts =
+				all_v<sig_traits<Sig>::template accepts<F>,
+					  sig_traits<Sigs>::template accepts<F>...>;
+			template <class F>
+			static constexpr bool accepts_const =
+				all_v<sig_traits<Sig>::template accepts_const<F>,
+					  sig_traits<Sigs>::template accepts_const<F>...>;
+		};
+
+		[[noreturn]] inline void throw_invalid_access() {
+			throw invalid_function_access{};
 		}
 
 		/**
-		 * Contructs a unique_function instance from a generic callable object
+		 * Implements the call operators of Derived, which must have an _ops
+		 * member pointing to an operations table (or null if empty), and a
+		 * _mem member holding the storage
+		 */
+		template <class Derived, class R, typename... Args>
+		class call_operator_base {
+			using invoker = fn_invoker<R, Args...>;
+
+		protected:
+			R call(param_t<Args>... args) const {
+				const Derived &self = static_cast<const Derived &>(*this);
+				if _unlikely (!self._ops) throw_invalid_access();
+				return static_cast<const invoker *>(self._ops)->invoke(
+					(void *)self._mem, libstra::forward<Args>(args)...);
+			}
+			R call_unchecked(param_t<Args>... args) const {
+				const Derived &self = static_cast<const Derived &>(*this);
+				_assume(self._ops);
+				return static_cast<const invoker *>(self._ops)->invoke(
+					(void *)self._mem, libstra::forward<Args>(args)...);
+			}
+		};
+
+		template <class Derived, class Sig>
+		class call_operator;
+
+		template <class Derived, class R, typename... Args>
+		class call_operator<Derived, R(Args...)>
+			: public call_operator_base<Derived, R, Args...> {
+		public:
+			/**
+			 * Attempts to invoke the function
+			 * @param args: The arguments to forward to the underlying callable
+			 * object
+			 * @throw Throws invalid_function_access if *this does not contain
+			 * a valid callable object, that is if has_value() returns false
+			 */
+			R operator()(param_t<Args>... args) {
+				return this->call(libstra::forward<Args>(args)...);
+			}
+			/**
+			 * Invokes the function without checking whether *this holds a
+			 * callable object. This compiles to a single indirect call, the
+			 * location of the object being known by the called function
+			 * @param args: The arguments to forward to the underlying callable
+			 * object
+			 * @warning If has_value() returns false, the behaviour is undefined
+			 */
+			R invoke_unchecked(param_t<Args>... args) {
+				return this->call_unchecked(libstra::forward<Args>(args)...);
+			}
+		};
+		template <class Derived, class R, typename... Args>
+		class call_operator<Derived, R(Args...) const>
+			: public call_operator_base<Derived, R, Args...> {
+		public:
+			/**
+			 * Attempts to invoke the function. The target is called as a const
+			 * object, so this may be done concurrently from several threads
+			 * @param args: The arguments to forward to the underlying callable
+			 * object
+			 * @throw Throws invalid_function_access if *this does not contain
+			 * a valid callable object, that is if has_value() returns false
+			 */
+			R operator()(param_t<Args>... args) const {
+				return this->call(libstra::forward<Args>(args)...);
+			}
+			/**
+			 * Invokes the function without checking whether *this holds a
+			 * callable object
+			 * @warning If has_value() returns false, the behaviour is undefined
+			 */
+			R invoke_unchecked(param_t<Args>... args) const {
+				return this->call_unchecked(libstra::forward<Args>(args)...);
+			}
+		};
+#if __cpp_noexcept_function_type
+		template <class Derived, class R, typename... Args>
+		class call_operator<Derived, R(Args...) noexcept>
+			: public call_operator_base<Derived, R, Args...> {
+		public:
+			/**
+			 * Invokes the function
+			 * @param args: The arguments to forward to the underlying callable
+			 * object
+			 * @note If has_value() returns false, std::terminate is called
+			 */
+			R operator()(param_t<Args>... args) noexcept {
+				return this->call(libstra::forward<Args>(args)...);
+			}
+			/**
+			 * Invokes the function without checking whether *this holds a
+			 * callable object
+			 * @warning If has_value() returns false, the behaviour is undefined
+			 */
+			R invoke_unchecked(param_t<Args>... args) noexcept {
+				return this->call_unchecked(libstra::forward<Args>(args)...);
+			}
+		};
+		template <class Derived, class R, typename... Args>
+		class call_operator<Derived, R(Args...) const noexcept>
+			: public call_operator_base<Derived, R, Args...> {
+		public:
+			/**
+			 * Invokes the function. The target is called as a const object, so
+			 * this may be done concurrently from several threads
+			 * @param args: The arguments to forward to the underlying callable
+			 * object
+			 * @note If has_value() returns false, std::terminate is called
+			 */
+			R operator()(param_t<Args>... args) const noexcept {
+				return this->call(libstra::forward<Args>(args)...);
+			}
+			/**
+			 * Invokes the function without checking whether *this holds a
+			 * callable object
+			 * @warning If has_value() returns false, the behaviour is undefined
+			 */
+			R invoke_unchecked(param_t<Args>... args) const noexcept {
+				return this->call_unchecked(libstra::forward<Args>(args)...);
+			}
+		};
+#endif
+		// One call operator per signature. Each level of the chain brings the
+		// operators of the next one into scope
+		template <class Derived, class Sig>
+		class call_operator<Derived, overloads<Sig>>
+			: public call_operator<Derived, Sig> {};
+		template <class Derived, class Sig, class Next, class... Sigs>
+		class call_operator<Derived, overloads<Sig, Next, Sigs...>>
+			: public call_operator<Derived, Sig>,
+			  public call_operator<Derived, overloads<Next, Sigs...>> {
+		public:
+			using call_operator<Derived, Sig>::operator();
+			using call_operator<Derived, Sig>::invoke_unchecked;
+			using call_operator<Derived, overloads<Next, Sigs...>>::operator();
+			using call_operator<Derived,
+								overloads<Next, Sigs...>>::invoke_unchecked;
+		};
+	} // namespace _details
+
+	namespace _details {
+		/**
+		 * Storage and lifetime management shared by the type-erased function
+		 * objects: holds the inline buffer and the pointer to the operations
+		 * table, which is null if the object is empty
+		 * @tparam Ops: The type of operations table
+		 * @tparam Size: The size of the inline buffer
+		 * @tparam Align: The alignment of the inline buffer
+		 */
+		template <class Ops, size_t Size, size_t Align>
+		class erased_function_base {
+			template <class, class, typename...>
+			friend class call_operator_base;
+
+		public:
+			/**
+			 * Indicates whether *this is a valid function object
+			 * @returns true if *this contains a valid callable object, false
+			 * otherwise
+			 */
+			[[nodiscard]]
+			constexpr bool has_value() const noexcept {
+				return (bool)_ops;
+			}
+			/**
+			 * Casts *this to a boolean
+			 * @return Same as has_value()
+			 */
+			[[nodiscard]] constexpr operator bool() const noexcept {
+				return has_value();
+			}
+#if LIBSTRA_HAS_RTTI
+			/**
+			 * @return typeid(T) if the stored function has type T, otherwise
+			 * typeid(void)
+			 * @note Only available if RTTI is enabled
+			 */
+			[[nodiscard]]
+			const std::type_info &target_type() const noexcept {
+				return _ops ? *_ops->type : typeid(void);
+			}
+#endif
+			/**
+			 * @returns A pointer to the stored function if it has type T,
+			 * otherwise a null pointer. Function pointers are identified by
+			 * the type of function they point to
+			 */
+			template <class T>
+			[[nodiscard]]
+			T *target() noexcept {
+				if (!_ops || _ops->id != type_id<T>()) return nullptr;
+				return target_ptr<T>(std::is_function<T>{});
+			}
+			/**
+			 * @returns A pointer to the stored function if it has type T,
+			 * otherwise a null pointer
+			 */
+			template <class T>
+			[[nodiscard]]
+			const T *target() const noexcept {
+				return const_cast<erased_function_base *>(this)
+					->template target<T>();
+			}
+
+		protected:
+			// Whether objects of type T are stored in the inline buffer. They
+			// need to be relocatable without throwing, because moving *this
+			// never throws
+			template <class T>
+			static constexpr bool is_inline_v =
+				sizeof(T) <= Size && alignof(T) <= Align &&
+				(std::is_nothrow_move_constructible<T>::value ||
+				 is_trivially_relocatable_v<T>);
+			template <class T>
+			using storage_t = erased_storage<T, is_inline_v<T>>;
+
+			constexpr erased_function_base() noexcept = default;
+			erased_function_base(erased_function_base &&other) noexcept {
+				move_from(other);
+			}
+			erased_function_base &
+			operator=(erased_function_base &&other) noexcept {
+				if (this == &other) return *this;
+				reset();
+				move_from(other);
+				return *this;
+			}
+			~erased_function_base() { reset(); }
+
+			/**
+			 * Stores an object of type T, constructed from x, in the storage
+			 * described by Store. *this must be empty
+			 * @tparam Sig: The signature to call the object through
+			 */
+			template <class Sig, class T, class Store = storage_t<T>,
+					  class... U>
+			void emplace(U &&...x) {
+				Store::create(_mem, libstra::forward<U>(x)...);
+				_ops = get_fn_ops<Store, T, Sig, Ops>();
+#if LIBSTRA_FUNCTION_STATS
+				record_construction<T>(Store::heap_bytes);
+#endif
+			}
+			// Destroys the stored object, if any, and leaves *this empty
+			void reset() noexcept {
+				if (!_ops) return;
+				_ops->destroy(_mem);
+				_ops = nullptr;
+			}
+			// Moves the content of other into *this, which must be empty
+			void move_from(erased_function_base &other) noexcept {
+				if (!other._ops) return;
+				if (other._ops->relocate)
+					other._ops->relocate(_mem, other._mem);
+				else std::memcpy(_mem, other._mem, sizeof(_mem));
+				_ops = other._ops;
+				other._ops = nullptr;
+			}
+			void swap(erased_function_base &other) noexcept {
+				erased_function_base tmp(std::move(other));
+				other.move_from(*this);
+				move_from(tmp);
+			}
+
+			alignas(Align) char _mem[Size];
+			const Ops *_ops = nullptr;
+
+		private:
+			// The object may be stored in any way, which only _ops knows
+			template <class T>
+			T *target_ptr(std::false_type) noexcept {
+				return (T *)_ops->get(_mem);
+			}
+			template <class T>
+			T *target_ptr(std::true_type) noexcept {
+				return *storage_t<T *>::get(_mem);
+			}
+		};
+	} // namespace _details
+
+	template <class Sig, size_t InlineBytes, size_t Align>
+	class basic_unique_function
+		: public _details::erased_function_base<
+			  typename _details::sig_traits<Sig>::ops_type, InlineBytes, Align>,
+		  public _details::call_operator<
+			  basic_unique_function<Sig, InlineBytes, Align>, Sig> {
+		static_assert(InlineBytes >= sizeof(void *) &&
+						  Align >= alignof(void *),
+					  "The inline buffer must be able to hold a pointer");
+		using traits = _details::sig_traits<Sig>;
+		using base = _details::erased_function_base<typename traits::ops_type,
+													InlineBytes, Align>;
+
+	public:
+		/* Default constructor: constructs an invalid function object */
+		constexpr basic_unique_function() noexcept = default;
+
+		/**
+		 * Contructs a basic_unique_function instance from a generic callable
+		 * object. If the object fits in the inline buffer, no allocation is
+		 * made
 		 */
 		template <class F,
 				  typename = std::enable_if_t<
-					  !std::is_same<std::decay_t<F>, unique_function>::value &&
-					  is_invocable_v<F, Args...>>>
-		unique_function(F &&f) {
+					  !std::is_same<std::decay_t<F>,
+									basic_unique_function>::value &&
+					  traits::template accepts<F>>>
+		basic_unique_function(F &&f) noexcept(
+			base::template is_inline_v<std::decay_t<F>> &&
+			std::is_nothrow_constructible<std::decay_t<F>, F>::value) {
+			this->template emplace<Sig, std::decay_t<F>>(
+				libstra::forward<F>(f));
+		}
+		/**
+		 * Contructs a basic_unique_function instance from a generic callable
+		 * object, using an allocator if the object doesn't fit in the inline
+		 * buffer. The memory is released with a copy of that allocator when
+		 * the function object is destroyed
+		 * @param alloc: The allocator to use, e.g. a
+		 * std::pmr::polymorphic_allocator to allocate from a memory resource
+		 */
+		template <class Alloc, class F,
+				  typename = std::enable_if_t<
+					  !std::is_same<std::decay_t<F>,
+									basic_unique_function>::value &&
+					  traits::template accepts<F>>>
+		basic_unique_function(std::allocator_arg_t, const Alloc &alloc,
+							  F &&f) {
 			using _Raw = std::decay_t<F>;
-			bool isSmall =
-				(_mem[sizeof(_mem) - 1] = (sizeof(_Raw) < sizeof(_mem)));
-			_tid = &typeid(_Raw);
-
-			if (isSmall) new (_mem) _Raw(libstra::forward<_Raw>(f));
-			else _ptr = new _Raw(libstra::forward<_Raw>(f));
-			if (isSmall && !std::is_trivially_constructible<_Raw>::value)
-				_deleter = [](void *ptr) { ((_Raw *)ptr)->~_Raw(); };
-			else _deleter = [](void *ptr) { delete (_Raw *)ptr; };
-			_invoke = [](void *f, Args &&...args) {
-				return (*(_Raw *)f)(libstra::forward<Args>(args)...);
-			};
+			create_with(
+				std::integral_constant<bool, base::template is_inline_v<_Raw>>{},
+				alloc, libstra::forward<F>(f));
 		}
-		unique_function(const unique_function &) = delete;
+		basic_unique_function(const basic_unique_function &) = delete;
 
 		/**
-		 * Constructs a unique_function by moving another
+		 * Constructs a basic_unique_function by moving another
 		 * @param other: The object to move from. This object is left in an
 		 * invalid state, such that a call to has_value() returns false
 		 */
-		unique_function(unique_function &&other) noexcept :
-			_deleter(other._deleter), _invoke(other._invoke), _tid(other._tid) {
-			for (size_t i = 0; i < sizeof(_mem); i++)
-				_mem[i] = other._mem[i];
-			other.reset();
-		}
+		basic_unique_function(basic_unique_function &&other) noexcept = default;
+
+		/**
+		 * Swaps the contents of *this with other
+		 * @param other: The other function object to swap the contents with
+		 */
+		void swap(basic_unique_function &other) noexcept { base::swap(other); }
+		basic_unique_function &operator=(basic_unique_function &) = delete;
 		/**
-		 * Indicates whether *this is a valid function object
-		 * @returns true if *this contains a valid callable object, false
-		 * otherwise
+		 * Destroys the current function object, then moves other into *this
+		 * @param other: The object to move from. This object is left in an
+		 * invalid state, such that a call to has_value() returns false
+		 */
+		basic_unique_function &
+		operator=(basic_unique_function &&other) noexcept = default;
+		template <class Func,
+				  typename = std::enable_if_t<!std::is_same<
+					  std::decay_t<Func>, basic_unique_function>::value>>
+		basic_unique_function &operator=(Func &&f) {
+			basic_unique_function(libstra::forward<Func>(f)).swap(*this);
+			return *this;
+		}
+		/** Returns a reference to the stored function object
+		 * @return A reference to the stored callable object if it has type T,
+		 * otherwise an empty reference
 		 */
+		template <class T>
 		[[nodiscard]]
-		constexpr bool has_value() const noexcept {
-			return (bool)_invoke;
+		function_ref<typename traits::function_type> get_ref() {
+			T *f = this->template target<T>();
+			if (!f) return {};
+			return *f;
 		}
+
+	private:
+		template <class Alloc, class F>
+		void create_with(std::true_type, const Alloc &, F &&f) {
+			this->template emplace<Sig, std::decay_t<F>>(
+				libstra::forward<F>(f));
+		}
+		template <class Alloc, class F>
+		void create_with(std::false_type, const Alloc &alloc, F &&f) {
+			using _Raw = std::decay_t<F>;
+			this->template emplace<
+				Sig, _Raw, _details::erased_alloc_storage<_Raw, Alloc>>(
+				alloc, libstra::forward<F>(f));
+		}
+	};
+
+	/**
+	 * A type-erased function object which never allocates: the target is
+	 * always stored in the inline buffer, and callable objects which don't fit
+	 * in it are rejected at compile time
+	 * @tparam Func: The underlying function type, which may be qualified like
+	 * for basic_unique_function
+	 * @tparam Capacity: The size of the inline buffer, in bytes
+	 * @tparam Align: The alignment of the inline buffer
+	 */
+	template <class Func, size_t Capacity = 4 * sizeof(void *),
+			  size_t Align = alignof(void *)>
+	class inplace_function
+		: public _details::erased_function_base<
+			  typename _details::sig_traits<Func>::ops_type, Capacity, Align>,
+		  public _details::call_operator<
+			  inplace_function<Func, Capacity, Align>, Func> {
+		using traits = _details::sig_traits<Func>;
+		using base = _details::erased_function_base<typename traits::ops_type,
+													Capacity, Align>;
+
+	public:
+		/* Default constructor: constructs an invalid function object */
+		constexpr inplace_function() noexcept = default;
+
 		/**
-		 * Casts *this to a boolean
-		 * @return Same as has_value()
+		 * Contructs an inplace_function instance from a generic callable
+		 * object, which must fit in the inline buffer, and be either nothrow
+		 * move constructible or trivially relocatable
 		 */
-		[[nodiscard]] constexpr operator bool() const noexcept {
-			return has_value();
+		template <class F, typename = std::enable_if_t<
+							   !std::is_same<std::decay_t<F>,
+											 inplace_function>::value &&
+							   traits::template accepts<F>>>
+		inplace_function(F &&f) noexcept(
+			std::is_nothrow_constructible<std::decay_t<F>, F>::value) {
+			using _Raw = std::decay_t<F>;
+			static_assert(base::template is_inline_v<_Raw>,
+						  "The callable object doesn't fit in the buffer of "
+						  "the inplace_function, or may throw when moved");
+			this->template emplace<Func, _Raw>(libstra::forward<F>(f));
 		}
+		inplace_function(const inplace_function &) = delete;
+		/**
+		 * Constructs an inplace_function by moving another
+		 * @param other: The object to move from. This object is left in an
+		 * invalid state, such that a call to has_value() returns false
+		 */
+		inplace_function(inplace_function &&other) noexcept = default;
 
 		/**
 		 * Swaps the contents of *this with other
 		 * @param other: The other function object to swap the contents with
 		 */
-		void swap(unique_function &other) noexcept {
-			std::swap(_mem, other._mem);
-			std::swap(_invoke, other._invoke);
-			std::swap(_deleter, other._deleter);
-			std::swap(_tid, other._tid);
-		}
-		unique_function &operator=(unique_function &) = delete;
-		unique_function &operator=(unique_function &&other) noexcept {
-			swap(other);
+		void swap(inplace_function &other) noexcept { base::swap(other); }
+		inplace_function &operator=(inplace_function &) = delete;
+		/**
+		 * Destroys the current function object, then moves other into *this
+		 * @param other: The object to move from. This object is left in an
+		 * invalid state, such that a call to has_value() returns false
+		 */
+		inplace_function &operator=(inplace_function &&other) noexcept = default;
+		template <class F, typename = std::enable_if_t<!std::is_same<
+							   std::decay_t<F>, inplace_function>::value>>
+		inplace_function &operator=(F &&f) {
+			inplace_function(libstra::forward<F>(f)).swap(*this);
 			return *this;
 		}
-		template <class Func, typename = std::enable_if_t<!std::is_same<
-								  std::decay_t<Func>, unique_function>::value>>
-		unique_function &operator=(Func &&f) {
-			using _Raw = std::decay_t<Func>;
-			_assume(_deleter);
-			_deleter(is_small() ? _mem : _ptr);
-			char isSmall = _mem[sizeof(_mem) - 1] =
-				(sizeof(_Raw) < sizeof(_mem));
-			if (isSmall) {
-				new (_mem) _Raw(libstra::forward<Func>(f));
-				if (!std::is_trivially_destructible<_Raw>::value)
-					_deleter = [](void *ptr) { ((_Raw *)ptr)->~_Raw(); };
-				else _deleter = [](void *) {};
-			} else {
-				_ptr = new _Raw(libstra::forward<Func>(f));
-				_deleter = [](void *ptr) { delete (_Raw *)ptr; };
-			}
-			_invoke = [](void *f, Args &&...args) {
-				return (*(_Raw *)f)(libstra::forward<Args>(args)...);
-			};
-			if (is_function_ptr_v<_Raw>) _tid = &typeid(R(Args...));
-			else _tid = &typeid(_Raw);
-			return *this;
+	};
+
+	/**
+	 * Represents a generic copyable callable object. Callable objects which
+	 * fit in the inline buffer are stored in place and copied by value,
+	 * others are allocated on the heap. Large objects may also be shared
+	 * between all the copies, see shared_target_t
+	 * @tparam Func: The underlying function type, which may be qualified like
+	 * for basic_unique_function
+	 * @tparam InlineBytes: The size of the inline buffer, in bytes
+	 * @tparam Align: The alignment of the inline buffer
+	 */
+	template <class Func, size_t InlineBytes = 2 * sizeof(void *),
+			  size_t Align = alignof(void *)>
+	class basic_copyable_function
+		: public _details::erased_function_base<
+			  _details::copyable_ops<
+				  typename _details::sig_traits<Func>::ops_type>,
+			  InlineBytes, Align>,
+		  public _details::call_operator<
+			  basic_copyable_function<Func, InlineBytes, Align>, Func> {
+		static_assert(InlineBytes >= sizeof(void *) &&
+						  Align >= alignof(void *),
+					  "The inline buffer must be able to hold a pointer");
+		using traits = _details::sig_traits<Func>;
+		using base = _details::erased_function_base<
+			_details::copyable_ops<typename traits::ops_type>, InlineBytes,
+			Align>;
+
+	public:
+		/* Default constructor: constructs an invalid function object */
+		constexpr basic_copyable_function() noexcept = default;
+
+		/**
+		 * Contructs a basic_copyable_function instance from a generic
+		 * copyable callable object. If the object fits in the inline buffer,
+		 * no allocation is made
+		 */
+		template <class F,
+				  typename = std::enable_if_t<
+					  !std::is_same<std::decay_t<F>,
+									basic_copyable_function>::value &&
+					  std::is_copy_constructible<std::decay_t<F>>::value &&
+					  traits::template accepts<F>>>
+		basic_copyable_function(F &&f) noexcept(
+			base::template is_inline_v<std::decay_t<F>> &&
+			std::is_nothrow_constructible<std::decay_t<F>, F>::value) {
+			this->template emplace<Func, std::decay_t<F>>(
+				libstra::forward<F>(f));
 		}
 		/**
-		 * Attempts to invoke the function
-		 * @param args: The arguments to forward to the underlying callable
+		 * Contructs a basic_copyable_function instance from a generic
+		 * copyable callable object. If the object doesn't fit in the inline
+		 * buffer, it is allocated once and shared by all the copies of *this
+		 * instead of being copied, so the target must be callable as a const
 		 * object
-		 * @throw Throws invalid_function_access if *this does not contain a
-		 * valid callable object, that is if has_value() returns false
 		 */
-		R operator()(Args &&...args) {
-			if (!_invoke) throw invalid_function_access{};
-			return _invoke(is_small() ? _mem : _ptr, forward<Args>(args)...);
+		template <class F,
+				  typename = std::enable_if_t<
+					  std::is_copy_constructible<std::decay_t<F>>::value &&
+					  traits::template accepts<F>>>
+		basic_copyable_function(shared_target_t, F &&f) {
+			using _Raw = std::decay_t<F>;
+			static_assert(traits::template accepts_const<F>,
+						  "A shared target must be callable as a const object");
+			create_shared(
+				std::integral_constant<bool, base::template is_inline_v<_Raw>>{},
+				libstra::forward<F>(f));
 		}
 		/**
-		 * @return typeid(T) if the stored function has type T, otherwise
-		 * typeid(void)
+		 * Constructs a copy of other. Shared targets are not copied, only
+		 * their reference count is incremented
 		 */
-		[[nodiscard]]
-		const std::type_info &target_type() const noexcept {
-			_assume(_tid);
-			return *_tid;
+		basic_copyable_function(const basic_copyable_function &other) :
+			base() {
+			if (!other._ops) return;
+			other._ops->copy(this->_mem, other._mem);
+			this->_ops = other._ops;
 		}
 		/**
-		 * @returns A pointer to the stored function if target_type() ==
-		 * typeid(T), otherwise a null pointer.
+		 * Constructs a basic_copyable_function by moving another
+		 * @param other: The object to move from. This object is left in an
+		 * invalid state, such that a call to has_value() returns false
+		 */
+		basic_copyable_function(basic_copyable_function &&other) noexcept =
+			default;
+
+		using base::target;
+		/**
+		 * @returns A pointer to the stored function if it has type T,
+		 * otherwise a null pointer. A shared target can't be modified, as
+		 * that would affect all the copies of *this, so it is only
+		 * accessible through the const overload
 		 */
 		template <class T>
 		[[nodiscard]]
 		T *target() noexcept {
-			_assume(_tid);
-			if (*_tid != typeid(T)) return nullptr;
-			return is_small() ? (T *)_mem : (T *)_ptr;
+			if (this->_ops && this->_ops->shared) return nullptr;
+			return base::template target<T>();
 		}
-		/** Returns a reference to the stored function object
-		 * @return A reference to the stored callable object if target_type() ==
-		 * T, otherwise an empty reference
+
+		/**
+		 * Swaps the contents of *this with other
+		 * @param other: The other function object to swap the contents with
 		 */
-		template <class T>
-		[[nodiscard]]
-		function_ref<R(Args...)> get_ref() {
-			_assume(_tid);
-			if (*_tid != typeid(T)) return {};
-			return *target<T>();
+		void swap(basic_copyable_function &other) noexcept {
+			base::swap(other);
 		}
 		/**
-		 * Destroys the function object
+		 * Destroys the current function object, then copies other into *this
 		 */
-		~unique_function() {
-			_assume(_deleter);
-			if (is_small()) _deleter(_mem);
-			else _deleter(_ptr);
+		basic_copyable_function &operator=(const basic_copyable_function &other) {
+			if (this != &other) basic_copyable_function(other).swap(*this);
+			return *this;
+		}
+		/**
+		 * Destroys the current function object, then moves other into *this
+		 * @param other: The object to move from. This object is left in an
+		 * invalid state, such that a call to has_value() returns false
+		 */
+		basic_copyable_function &
+		operator=(basic_copyable_function &&other) noexcept = default;
+		template <class F, typename = std::enable_if_t<!std::is_same<
+							   std::decay_t<F>, basic_copyable_function>::value>>
+		basic_copyable_function &operator=(F &&f) {
+			basic_copyable_function(libstra::forward<F>(f)).swap(*this);
+			return *this;
 		}
 
 	private:
-		inline bool is_small() const noexcept { return _mem[sizeof(_mem) - 1]; }
-		inline void reset() noexcept {
-			_deleter = [](void *) {};
-			for (char &x : _mem)
-				x = 0;
-			_invoke = nullptr;
-			_tid = &typeid(void);
-		}
-		union {
-			char _mem[2 * alignof(void *)] = { 0 };
-			void *_ptr;
-		};
-		void (*_deleter)(void *ptr) = [](void *) {};
-		R (*_invoke)(void *, Args &&...) = nullptr;
-		const std::type_info *_tid = &typeid(void);
+		template <class F>
+		void create_shared(std::true_type, F &&f) {
+			this->template emplace<Func, std::decay_t<F>>(
+				libstra::forward<F>(f));
+		}
+		template <class F>
+		void create_shared(std::false_type, F &&f) {
+			using _Raw = std::decay_t<F>;
+			this->template emplace<Func, _Raw,
+								   _details::erased_shared_storage<_Raw>>(
+				libstra::forward<F>(f));
+		}
 	};
 
+	/**
+	 * Represents a generic copyable callable object
+	 * @tparam Func: The underlying function type
+	 */
+	template <class Func>
+	using copyable_function = basic_copyable_function<Func>;
+
 	template <class F>
 	struct invoke_result;
 
-	template <class R, typename... Args>
-	struct invoke_result<unique_function<R(Args...)>> {
-		using type = R;
+	template <class Sig, size_t InlineBytes, size_t Align>
+	struct invoke_result<basic_unique_function<Sig, InlineBytes, Align>> {
+		using type = typename _details::sig_traits<Sig>::result_type;
 	};
 	template <class R, typename... Args>
 	struct invoke_result<function_ref<R(Args...)>> {
 		using type = R;
 	};
 
+	template <class Sig, size_t Capacity, size_t Align>
+	struct invoke_result<inplace_function<Sig, Capacity, Align>> {
+		using type = typename _details::sig_traits<Sig>::result_type;
+	};
+	template <class Sig, size_t InlineBytes, size_t Align>
+	struct invoke_result<basic_copyable_function<Sig, InlineBytes, Align>> {
+		using type = typename _details::sig_traits<Sig>::result_type;
+	};
+
 	template <class F>
 	using invoke_result_t = typename invoke_result<F>::type;
 
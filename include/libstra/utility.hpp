@@ -93,7 +93,9 @@ namespace libstra {
 	using make_index_sequence = make_integer_sequence<size_t, N>;
 
 	template <class F, class Tuple, size_t... I>
-	constexpr decltype(auto) apply(index_sequence<I...>, F &&f, Tuple &&args) {
+	constexpr decltype(auto)
+	apply(index_sequence<I...>, F &&f, Tuple &&args) noexcept(
+		noexcept(f(std::get<I>(std::forward<Tuple>(args))...))) {
 		return f(std::get<I>(std::forward<Tuple>(args))...);
 	}
 	/**
@@ -107,8 +109,12 @@ namespace libstra {
 	 * passed using perfect forwarding
 	 */
 	template <class F, class Tuple>
-	constexpr decltype(auto) apply(F &&f, Tuple &&args) {
-		using Indices = make_index_sequence<std::tuple_size<Tuple>::value>;
+	constexpr decltype(auto) apply(F &&f, Tuple &&args) noexcept(
+		noexcept(apply(make_index_sequence<std::tuple_size<
+						   std::remove_reference_t<Tuple>>::value>{},
+					   std::forward<F>(f), std::forward<Tuple>(args)))) {
+		using Indices = make_index_sequence<
+			std::tuple_size<std::remove_reference_t<Tuple>>::value>;
 		return apply(Indices{}, std::forward<F>(f), std::forward<Tuple>(args));
 	}
 
@@ -410,6 +416,15 @@ namespace libstra {
 							  std::void_t<invoke_t<F, Args...>>>
 			: std::true_type {};
 
+		template <class F, class Args, class = void>
+		struct nothrow_invokable_with : std::false_type {};
+
+		template <class F, class... Args>
+		struct nothrow_invokable_with<F, Pack_t<Args...>,
+									  std::void_t<invoke_t<F, Args...>>>
+			: bool_constant<noexcept(
+				  std::declval<F>()(std::declval<Args>()...))> {};
+
 	} // namespace _details
 
 	template <class T, class U>
@@ -423,6 +438,14 @@ namespace libstra {
 	template <class T, class... Args>
 	static constexpr bool is_invocable_v = is_invocable<T, Args...>::value;
 
+	template <class T, class... Args>
+	struct is_nothrow_invocable
+		: _details::nothrow_invokable_with<T, _details::Pack_t<Args...>> {};
+
+	template <class T, class... Args>
+	static constexpr bool is_nothrow_invocable_v =
+		is_nothrow_invocable<T, Args...>::value;
+
 	template <class T>
 	struct type_identity {
 		using type = T;
@@ -519,6 +542,20 @@ namespace libstra {
 	static constexpr bool is_regular_v =
 		is_semiregular_v<T> && is_equality_comparable_v<T, T>;
 
+	/**
+	 * Declares a static bool constant equal to true if moving an object of
+	 * type T to a new location and destroying the original is equivalent to
+	 * copying its bytes with memcpy. By default, only trivially copyable types
+	 * are considered trivially relocatable, but this trait may be specialized
+	 * for other types which satisfy this requirement (e.g. std::unique_ptr)
+	 */
+	template <class T>
+	struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+	template <class T>
+	static constexpr bool is_trivially_relocatable_v =
+		is_trivially_relocatable<T>::value;
+
 	namespace _details {
 		template <class T, class = void>
 		struct incrementable : std::false_type {};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <libstra/mpmc_queue.hpp>
+
+namespace libstra {
+	/**
+	 * A work-stealing deque (Chase and Lev's algorithm, with the memory
+	 * orderings of Lê et al.). The owner thread pushes and pops elements at
+	 * the bottom, while any other thread may steal elements from the top.
+	 * The buffer grows as needed; the old buffers are kept until the deque is
+	 * destroyed, since thieves may still be reading them
+	 * @tparam T: The type of elements, which must be trivially copyable,
+	 * typically a pointer
+	 */
+	template <class T>
+	class ws_deque {
+		static_assert(std::is_trivially_copyable<T>::value,
+					  "The elements of a ws_deque must be trivially copyable");
+
+		struct array {
+			std::ptrdiff_t mask;
+			std::unique_ptr<std::atomic<T>[]> buf;
+
+			explicit array(std::ptrdiff_t cap) :
+				mask(cap - 1), buf(new std::atomic<T>[cap]) {}
+			T get(std::ptrdiff_t i) const noexcept {
+				return buf[i & mask].load(std::memory_order_relaxed);
+			}
+			void put(std::ptrdiff_t i, T x) noexcept {
+				buf[i & mask].store(x, std::memory_order_relaxed);
+			}
+		};
+
+	public:
+		/**
+		 * Constructs the deque
+		 * @param capacity: The initial capacity, rounded up to a power of 2
+		 */
+		explicit ws_deque(size_t capacity = 64) {
+			std::ptrdiff_t n = 2;
+			while ((size_t)n < capacity)
+				n *= 2;
+			_arrays.emplace_back(new array(n));
+			_array.store(_arrays.back().get(), std::memory_order_relaxed);
+		}
+		ws_deque(const ws_deque &) = delete;
+		ws_deque &operator=(const ws_deque &) = delete;
+
+		/**
+		 * Adds an element at the bottom. Must only be called by the owner
+		 * @param x: The element to add
+		 */
+		void push(T x) {
+			std::ptrdiff_t b = _bottom.load(std::memory_order_relaxed);
+			std::ptrdiff_t t = _top.load(std::memory_order_acquire);
+			array *a = _array.load(std::memory_order_relaxed);
+			if (b - t > a->mask) a = grow(a, t, b);
+			a->put(b, x);
+			std::atomic_thread_fence(std::memory_order_release);
+			_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		/**
+		 * Removes the element at the bottom, i.e. the last one pushed. Must
+		 * only be called by the owner
+		 * @param out: The object to copy the element into
+		 * @return true if an element was removed, false if the deque was
+		 * empty
+		 */
+		bool pop(T &out) noexcept {
+			std::ptrdiff_t b = _bottom.load(std::memory_order_relaxed) - 1;
+			array *a = _array.load(std::memory_order_relaxed);
+			_bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::ptrdiff_t t = _top.load(std::memory_order_relaxed);
+			if (t > b) {
+				_bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+			out = a->get(b);
+			if (t == b) {
+				// last element, race against the thieves
+				bool won = _top.compare_exchange_strong(
+					t, t + 1, std::memory_order_seq_cst,
+					std::memory_order_relaxed);
+				_bottom.store(b + 1, std::memory_order_relaxed);
+				return won;
+			}
+			return true;
+		}
+
+		/**
+		 * Removes the element at the top, i.e. the oldest one. May be called
+		 * by any thread
+		 * @param out: The object to copy the element into
+		 * @return true if an element was removed, false if the deque was
+		 * empty or another thread took the element first
+		 */
+		bool steal(T &out) noexcept {
+			std::ptrdiff_t t = _top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::ptrdiff_t b = _bottom.load(std::memory_order_acquire);
+			if (t >= b) return false;
+			array *a = _array.load(std::memory_order_acquire);
+			T x = a->get(t);
+			if (!_top.compare_exchange_strong(t, t + 1,
+											  std::memory_order_seq_cst,
+											  std::memory_order_relaxed))
+				return false;
+			out = x;
+			return true;
+		}
+
+		/**
+		 * @return The number of elements. This is only an estimate if other
+		 * threads are using the deque concurrently
+		 */
+		[[nodiscard]]
+		size_t size_approx() const noexcept {
+			std::ptrdiff_t b = _bottom.load(std::memory_order_relaxed);
+			std::ptrdiff_t t = _top.load(std::memory_order_relaxed);
+			return b > t ? size_t(b - t) : 0;
+		}
+
+	private:
+		array *grow(array *a, std::ptrdiff_t t, std::ptrdiff_t b) {
+			_arrays.emplace_back(new array(2 * (a->mask + 1)));
+			array *next = _arrays.back().get();
+			for (std::ptrdiff_t i = t; i < b; ++i)
+				next->put(i, a->get(i));
+			_array.store(next, std::memory_order_release);
+			return next;
+		}
+
+		char _pad0[_details::cache_line_size];
+		std::atomic<std::ptrdiff_t> _top{ 0 };
+		char _pad1[_details::cache_line_size - sizeof(std::ptrdiff_t)];
+		std::atomic<std::ptrdiff_t> _bottom{ 0 };
+		std::atomic<array *> _array;
+		// All the buffers ever allocated, only accessed by the owner
+		std::vector<std::unique_ptr<array>> _arrays;
+	};
+} // namespace libstra
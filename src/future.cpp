@@ -0,0 +1,37 @@
+#include <libstra/future.hpp>
+
+namespace libstra {
+	namespace _details {
+		void state_base::wait() {
+			if (ready()) return;
+			std::unique_lock<std::mutex> lk(_m);
+			_cv.wait(lk, [this]() { return this->ready(); });
+		}
+		void state_base::set_next(state_base *next) noexcept {
+			next->add_ref();
+			{
+				std::lock_guard<std::mutex> lk(_m);
+				if (!ready()) {
+					_next = next;
+					return;
+				}
+			}
+			next->_notify(next, this);
+			next->release();
+		}
+		void state_base::complete() noexcept {
+			state_base *next;
+			// the continuations attached from now on don't use the pool
+			_pool.store(nullptr, std::memory_order_relaxed);
+			{
+				std::lock_guard<std::mutex> lk(_m);
+				_ready.store(true, std::memory_order_release);
+				next = _next;
+			}
+			_cv.notify_all();
+			if (!next) return;
+			next->_notify(next, this);
+			next->release();
+		}
+	} // namespace _details
+} // namespace libstra
@@ -0,0 +1,42 @@
+#include <libstra/parallel.hpp>
+
+namespace libstra {
+	namespace _details {
+		parallel_state::parallel_state(size_t n, size_t grain,
+									   size_t workers) noexcept :
+			_n(n), _grain(grain), _workers(workers) {}
+
+		bool parallel_state::claim(size_t &lo, size_t &hi) noexcept {
+			size_t i = _next.load(std::memory_order_relaxed);
+			for (;;) {
+				if (i >= _n) return false;
+				// a share of what's left, but at least grain
+				size_t chunk = (_n - i) / (2 * _workers);
+				if (chunk < _grain) chunk = _grain;
+				size_t j = _n - i > chunk ? i + chunk : _n;
+				if (_next.compare_exchange_weak(i, j,
+												std::memory_order_relaxed)) {
+					lo = i;
+					hi = j;
+					return true;
+				}
+			}
+		}
+		void parallel_state::finish(size_t count,
+									std::exception_ptr e) noexcept {
+			bool last;
+			{
+				std::lock_guard<std::mutex> lk(_m);
+				if (e && !_error) _error = std::move(e);
+				_done += count;
+				last = _done == _n;
+			}
+			if (last) _cv.notify_all();
+		}
+		void parallel_state::wait() {
+			std::unique_lock<std::mutex> lk(_m);
+			_cv.wait(lk, [this]() { return this->_done == this->_n; });
+			if (_error) std::rethrow_exception(_error);
+		}
+	} // namespace _details
+} // namespace libstra
@@ -1,54 +1,310 @@
 #include <libstra/thread_pool.hpp>
+#include <cstdint>
 
 namespace libstra {
 	using unique_lock = std::unique_lock<std::mutex>;
 	using lock_guard = std::lock_guard<std::mutex>;
 
-	thread_pool::thread_pool(size_t n) {
+	namespace {
+		// The pool the current thread belongs to, and its index in it
+		thread_local thread_pool *current_pool = nullptr;
+		thread_local size_t current_index = 0;
+		// How often help_until checks a condition the pool isn't notified of
+		constexpr std::chrono::milliseconds poll_interval(1);
+		// State of the generator used to pick the victims of steals
+		thread_local uint32_t rng_state = 0;
+
+		/* The tasks being run by the current thread, innermost first. A
+		 * thread may run tasks while it waits, so it isn't necessarily one of
+		 * the pool's threads, and may run tasks of several pools at once */
+		struct running_task {
+			const thread_pool *pool;
+			running_task *outer;
+		};
+		thread_local running_task *running_tasks = nullptr;
+
+		bool runs_task_of(const thread_pool *pool) noexcept {
+			for (running_task *t = running_tasks; t; t = t->outer) {
+				if (t->pool == pool) return true;
+			}
+			return false;
+		}
+
+		// Tasks never throw, and terminate the program if they do
+		template <class Task>
+		void invoke_task(Task &task) noexcept {
+			task.invoke_unchecked();
+		}
+
+		uint32_t next_random() noexcept {
+			uint32_t x = rng_state;
+			if (!x) x = (uint32_t)(uintptr_t)&rng_state | 1;
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			return rng_state = x;
+		}
+	} // namespace
+
+	thread_pool::thread_pool(size_t n) : thread_pool(n, {}) {}
+	thread_pool::thread_pool(size_t n, const thread_pool_options &opt) :
+		_starvation_limit(opt.starvation_limit),
+		_exception_handler(opt.exception_handler) {
+		if (opt.lock_free_capacity)
+			_lf_tasks.reset(new mpmc_queue<_task_t>(opt.lock_free_capacity));
+		if (opt.work_stealing) {
+			for (size_t i = 0; i < n; i++)
+				_workers.emplace_back(new _worker);
+		}
 		for (size_t i = 0; i < n; i++) {
-			_threads.emplace_back(&thread_pool::thread_loop, this);
+			_threads.emplace_back(&thread_pool::thread_loop, this, i);
+		}
+	}
+	void thread_pool::push(_task_t &&task, task_priority prio) {
+		const size_t lane = size_t(prio);
+		if (prio == task_priority::normal && !_workers.empty() &&
+			current_pool == this) {
+			std::unique_ptr<_task_t> p = box(std::move(task));
+			pushed(lane, 1);
+			try {
+				// growing the deque may throw
+				_workers[current_index]->deque.push(p.get());
+			} catch (...) {
+				popped(lane);
+				finish_task();
+				throw;
+			}
+			// owned by the deque from now on
+			p.release();
+		} else {
+			pushed(lane, 1);
+			if (prio != task_priority::normal || !_lf_tasks ||
+				!_lf_tasks->try_push(std::move(task))) {
+				try {
+					lock_guard lk(_mutex);
+					_tasks[lane].push(std::move(task));
+				} catch (...) {
+					popped(lane);
+					finish_task();
+					throw;
+				}
+			}
+		}
+		/* An idle thread increments _idle before checking _queued under the
+		 * lock, so either it sees the task, or we see it and wake it up. The
+		 * same goes for _waiting, which counts the threads blocked in wait */
+		if (_idle.load()) {
+			{ lock_guard lk(_mutex); }
+			_cv.notify_one();
+		} else if (_waiting.load()) {
+			{ lock_guard lk(_mutex); }
+			_done_cv.notify_all();
+		}
+	}
+	void thread_pool::push_bulk(_task_t *tasks, size_t n) {
+		if (!n) return;
+		const size_t lane = size_t(task_priority::normal);
+		pushed(lane, n);
+		size_t idle, waiting, i = 0;
+		try {
+			lock_guard lk(_mutex);
+			for (; i < n; ++i)
+				_tasks[lane].push(std::move(tasks[i]));
+			// threads which go idle after this will see the tasks
+			idle = _idle.load();
+			waiting = _waiting.load();
+		} catch (...) {
+			// only the first i tasks were queued
+			popped(lane, n - i);
+			_unfinished.fetch_sub(n - i - 1, std::memory_order_relaxed);
+			finish_task();
+			_cv.notify_all();
+			_done_cv.notify_all();
+			throw;
+		}
+		if (n > idle && waiting) _done_cv.notify_all();
+		if (!idle) return;
+		if (n >= idle) _cv.notify_all();
+		else {
+			while (n--)
+				_cv.notify_one();
+		}
+	}
+	bool thread_pool::try_pop(_task_t &task) {
+		if (!_queued.load(std::memory_order_acquire)) return false;
+		const size_t high = size_t(task_priority::high),
+					 background = size_t(task_priority::background);
+		if (_depth[high].load(std::memory_order_relaxed) ||
+			_depth[background].load(std::memory_order_relaxed)) {
+			/* Every _starvation_limit tasks, the lanes are visited from the
+			 * lowest priority to the highest, so that none of them starves */
+			if (_starvation_limit &&
+				_turn.fetch_add(1, std::memory_order_relaxed) %
+						_starvation_limit ==
+					_starvation_limit - 1) {
+				return pop_lane(background, task) || pop_normal(task) ||
+					   pop_lane(high, task);
+			}
+			if (pop_lane(high, task)) return true;
+		}
+		return pop_normal(task) || pop_lane(background, task);
+	}
+	bool thread_pool::pop_lane(size_t lane, _task_t &task) {
+		if (!depth(task_priority(lane))) return false;
+		lock_guard lk(_mutex);
+		if (_tasks[lane].empty()) return false;
+		task = std::move(_tasks[lane].front());
+		_tasks[lane].pop();
+		popped(lane);
+		return true;
+	}
+	bool thread_pool::pop_normal(_task_t &task) {
+		const size_t lane = size_t(task_priority::normal);
+		if (!depth(task_priority::normal)) return false;
+		_task_t *p;
+		if (!_workers.empty() && current_pool == this &&
+			_workers[current_index]->deque.pop(p)) {
+			unbox(p, task);
+			popped(lane);
+			return true;
+		}
+		if (_lf_tasks && _lf_tasks->try_pop(task)) {
+			popped(lane);
+			return true;
+		}
+		return pop_lane(lane, task) || (!_workers.empty() && steal(task));
+	}
+	void thread_pool::pushed(size_t lane, size_t n) noexcept {
+		_unfinished.fetch_add(n, std::memory_order_relaxed);
+		if (lane != size_t(task_priority::normal))
+			_depth[lane].fetch_add(n, std::memory_order_relaxed);
+		_queued.fetch_add(n);
+	}
+	void thread_pool::popped(size_t lane, size_t n) noexcept {
+		if (lane != size_t(task_priority::normal))
+			_depth[lane].fetch_sub(n, std::memory_order_relaxed);
+		_queued.fetch_sub(n, std::memory_order_relaxed);
+	}
+	bool thread_pool::steal(_task_t &task) {
+		size_t n = _workers.size(), start = next_random() % n;
+		_task_t *p;
+		for (size_t i = 0; i < n; ++i) {
+			size_t victim = (start + i) % n;
+			if (current_pool == this && victim == current_index) continue;
+			if (_workers[victim]->deque.steal(p)) {
+				unbox(p, task);
+				popped(size_t(task_priority::normal));
+				return true;
+			}
+		}
+		return false;
+	}
+	std::unique_ptr<thread_pool::_task_t> thread_pool::box(_task_t &&task) {
+		auto &spare = _workers[current_index]->spare;
+		if (spare.empty())
+			return std::unique_ptr<_task_t>(new _task_t(std::move(task)));
+		std::unique_ptr<_task_t> p = std::move(spare.back());
+		spare.pop_back();
+		*p = std::move(task);
+		return p;
+	}
+	void thread_pool::unbox(_task_t *p, _task_t &task) noexcept {
+		task = std::move(*p);
+		if (current_pool == this) {
+			// the capacity is reserved, so this doesn't allocate
+			auto &spare = _workers[current_index]->spare;
+			if (spare.size() < _spare_boxes) {
+				spare.emplace_back(p);
+				return;
+			}
+		}
+		delete p;
+	}
+	bool thread_pool::run_one() {
+		{
+			_task_t task;
+			if (!try_pop(task)) return false;
+			running_task self{ this, running_tasks };
+			running_tasks = &self;
+			invoke_task(task);
+			running_tasks = self.outer;
+		}
+		finish_task();
+		return true;
+	}
+	void thread_pool::finish_task() {
+		_unfinished.fetch_sub(1);
+		// the waiting threads check their own condition
+		if (_waiting.load()) {
+			{ lock_guard lk(_mutex); }
+			_done_cv.notify_all();
+		}
+	}
+	void thread_pool::on_exception(std::exception_ptr e) noexcept {
+		if (_exception_handler) _exception_handler(std::move(e));
+		else std::terminate();
+	}
+	void thread_pool::help_until(function_ref<bool()> done, bool poll) {
+		while (!done()) {
+			if (run_one()) continue;
+
+			unique_lock lk(_mutex);
+			_waiting.fetch_add(1);
+			auto ready = [this, &done]() {
+				return this->_stopped || this->_queued.load() || done();
+			};
+			if (poll) _done_cv.wait_for(lk, poll_interval, ready);
+			else _done_cv.wait(lk, ready);
+			_waiting.fetch_sub(1, std::memory_order_relaxed);
+			if (_stopped && !_queued.load()) return;
 		}
 	}
 	void thread_pool::wait() {
-		unique_lock lk(_mutex);
 		if (_stopped) return;
-
-		_cv.wait(lk, [this]() { return !this->_current_tasks; });
+		if (!runs_task_of(this)) {
+			help_until([this]() { return !this->_unfinished.load(); });
+			return;
+		}
+		/* The tasks waiting from inside the pool can't finish until they
+		 * return, so they aren't waited for */
+		_nested.fetch_add(1);
+		help_until([this]() {
+			return this->_unfinished.load() <= this->_nested.load();
+		});
+		_nested.fetch_sub(1);
 	}
 	void thread_pool::stop() {
+		wait();
 		{
-			unique_lock lk(_mutex);
+			lock_guard lk(_mutex);
 			if (_stopped) return;
-
-			_cv.wait(lk, [this]() { return !this->_current_tasks; });
-
 			_stopped = true;
 		}
 		_cv.notify_all();
+		_done_cv.notify_all();
 		join_threads();
 	}
 	void thread_pool::restart() {
 		lock_guard lk(_mutex);
 		if (!_stopped) return;
 
-		for (auto &t : _threads) {
-			t = std::thread(&thread_pool::thread_loop, this);
+		_stopped = false;
+		for (size_t i = 0; i < _threads.size(); i++) {
+			_threads[i] = std::thread(&thread_pool::thread_loop, this, i);
 		}
 	}
-	void thread_pool::thread_loop() {
-		for (;;) {
+	void thread_pool::thread_loop(size_t index) {
+		current_pool = this;
+		current_index = index;
+		while (!_stopped.load(std::memory_order_acquire)) {
+			if (run_one()) continue;
+
 			unique_lock lk(_mutex);
+			_idle.fetch_add(1);
 			_cv.wait(lk, [this]() {
-				return this->_stopped || this->_current_tasks;
+				return this->_stopped || this->_queued.load();
 			});
-			if (_stopped) return;
-			auto task = std::move(_tasks.front());
-			_tasks.pop();
-			bool notify = !--_current_tasks;
-
-			lk.unlock();
-			task();
-			if (notify) _cv.notify_all();
+			_idle.fetch_sub(1, std::memory_order_relaxed);
 		}
 	}
 
@@ -62,11 +318,16 @@ namespace libstra {
 	thread_pool::~thread_pool() {
 		{
 			lock_guard lk(_mutex);
-			if (_stopped) return;
 			_stopped = true;
 		}
 		_cv.notify_all();
 		join_threads();
+		/* The tasks left are destroyed without being run, which may queue
+		 * others: the continuations of the futures they break */
+		for (;;) {
+			_task_t task;
+			if (!try_pop(task)) break;
+		}
 	}
 
 } // namespace libstra
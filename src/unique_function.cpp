@@ -0,0 +1,29 @@
+#include <libstra/unique_function.hpp>
+
+namespace libstra {
+#if LIBSTRA_HAS_RTTI
+	namespace _details {
+		namespace {
+			// The most recently registered target type
+			std::atomic<const ref_target *> ref_targets{ nullptr };
+		} // namespace
+
+		ref_target::ref_target(void (*invoke)(),
+							   const std::type_info &type) noexcept :
+			_invoke(invoke),
+			_type(type), _next(ref_targets.load(std::memory_order_relaxed)) {
+			while (!ref_targets.compare_exchange_weak(
+				_next, this, std::memory_order_release,
+				std::memory_order_relaxed)) {
+			}
+		}
+		const std::type_info &ref_target::find(void (*invoke)()) noexcept {
+			const ref_target *t = ref_targets.load(std::memory_order_acquire);
+			for (; t; t = t->_next) {
+				if (t->_invoke == invoke) return t->_type;
+			}
+			return typeid(void);
+		}
+	} // namespace _details
+#endif
+} // namespace libstra
@@ -0,0 +1,102 @@
+#include <libstra/function_vector.hpp>
+#include <cassert>
+#include <string>
+
+static int instances = 0;
+
+struct Counted {
+	int *out;
+	Counted(int *o) : out(o) { ++instances; }
+	Counted(Counted &&other) noexcept : out(other.out) { ++instances; }
+	~Counted() { --instances; }
+	void operator()(int x) { *out += x; }
+};
+
+// May throw when moved, so it gets allocated on the heap
+struct ThrowingMove {
+	int *out;
+	ThrowingMove(int *o) : out(o) { ++instances; }
+	ThrowingMove(const ThrowingMove &other) : out(other.out) { ++instances; }
+	~ThrowingMove() { --instances; }
+	void operator()(int x) { *out -= x; }
+};
+
+void basic_tests() {
+	libstra::function_vector<void(int)> v;
+	assert(v.empty() && !v.capacity());
+	v.invoke_all(1);
+
+	int a = 0, b = 0;
+	char big[64] = { 5 };
+	v.push_back([&a](int x) { a += x; });
+	v.push_back([&a, big](int x) { a += big[0] * x; });
+	v.push_back(Counted{ &b });
+	v.push_back(ThrowingMove{ &b });
+	assert(v.size() == 4);
+	assert(instances == 2);
+	v.invoke_all(2);
+	assert(a == 12);
+	assert(b == 0);
+
+	// grow the buffer, all the objects must survive the relocation
+	size_t cap = v.capacity();
+	for (int i = 0; i < 100; ++i)
+		v.push_back(Counted{ &b });
+	assert(v.capacity() > cap);
+	assert(v.size() == 104);
+	assert(instances == 102);
+	v.invoke_all(1);
+	assert(a == 18);
+	assert(b == 100);
+
+	cap = v.capacity();
+	v.clear();
+	assert(v.empty() && instances == 0);
+	assert(v.capacity() == cap);
+	v.invoke_all(1);
+	assert(a == 18);
+}
+
+void argument_tests() {
+	libstra::function_vector<void(std::string, int &)> v;
+	std::string out;
+	for (int i = 0; i < 3; ++i) {
+		v.push_back([&out](std::string s, int &n) {
+			out += s;
+			++n;
+		});
+	}
+	int n = 0;
+	// every callable object must receive its own copy of the string
+	v.invoke_all(std::string("ab"), n);
+	assert(out == "ababab");
+	assert(n == 3);
+}
+
+void move_tests() {
+	int a = 0;
+	libstra::function_vector<int(int)> v;
+	v.push_back([c = Counted{ &a }](int x) mutable {
+		c(x);
+		return x;
+	});
+	v.push_back([](int x) { return x; });
+	libstra::function_vector<int(int)> v2 = std::move(v);
+	assert(v.empty() && !v.capacity());
+	assert(v2.size() == 2 && instances == 1);
+	v2.invoke_all(3);
+	assert(a == 3);
+	v = std::move(v2);
+	assert(v.size() == 2);
+	v2.push_back([](int x) { return x; });
+	v.swap(v2);
+	assert(v.size() == 1 && v2.size() == 2);
+	v2 = libstra::function_vector<int(int)>{};
+	assert(instances == 0);
+}
+
+int main() {
+	basic_tests();
+	argument_tests();
+	move_tests();
+}
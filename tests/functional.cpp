@@ -0,0 +1,69 @@
+#include <libstra/functional.hpp>
+#include <libstra/unique_function.hpp>
+#include <cassert>
+#include <memory>
+#include <string>
+
+struct A {
+	int v;
+	int add(int x) { return v + x; }
+	int get() const { return v; }
+};
+
+int sub(int a, int b) {
+	return a - b;
+}
+
+void bind_front_tests() {
+	auto f = libstra::bind_front(sub, 5);
+	assert(f(2) == 3);
+	// empty objects take no space
+	auto g = libstra::bind_front([](int a, int b) { return a * b; }, 3);
+	static_assert(sizeof(g) == sizeof(int), "bind_front size test failed");
+	assert(g(4) == 12);
+
+	A a{ 2 };
+	auto h = libstra::bind_front(&A::add, &a);
+	assert(h(3) == 5);
+	const auto c = libstra::bind_front(&A::get, a);
+	assert(c() == 2);
+	auto d = libstra::bind_front(&A::v, std::ref(a));
+	assert(d() == 2);
+
+	// bound arguments are moved from when the binder is an rvalue
+	auto p = libstra::bind_front(
+		[](std::unique_ptr<int> p, int x) { return *p + x; },
+		std::make_unique<int>(1));
+	assert(std::move(p)(2) == 3);
+}
+
+void bind_back_tests() {
+	auto f = libstra::bind_back(sub, 5);
+	assert(f(2) == -3);
+	std::string s = "abc";
+	auto g = libstra::bind_back(
+		[](const std::string &a, const std::string &b) { return a + b; }, s);
+	assert(g("x") == "xabc");
+}
+
+void unique_function_tests() {
+	A a{ 1 };
+	// an empty callable and an object pointer fit in the default buffer
+	libstra::unique_function<int(int)> f = libstra::bind_front(
+		[](A *a, int x) { return a->add(x); }, &a);
+	assert(f(1) == 2);
+#if __cpp_nontype_template_parameter_auto
+	auto b = libstra::bind_front<&A::add>(&a);
+	static_assert(sizeof(b) == sizeof(A *), "bind_front size test failed");
+	libstra::unique_function<int(int)> g = b;
+	assert(g(2) == 3);
+	auto c = libstra::bind_back<sub>(1);
+	assert(c(3) == 2);
+#endif
+}
+
+int main() {
+	bind_front_tests();
+	bind_back_tests();
+	unique_function_tests();
+}
@@ -0,0 +1,194 @@
+#include <libstra/future.hpp>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+void test1() {
+	libstra::promise<int> p;
+	auto f = p.get_future();
+	assert(f.valid() && !f.ready());
+	p.set_value(42);
+	assert(f.ready());
+	int x = f.get();
+	assert(x == 42);
+	assert(!f.valid());
+
+	libstra::future<void> g;
+	{
+		libstra::promise<void> q;
+		g = q.get_future();
+	}
+	try {
+		g.get();
+		assert(false);
+	} catch (const libstra::broken_promise &) {
+	}
+}
+
+void test2() {
+	libstra::thread_pool tp(2);
+	auto f = libstra::async(tp, [](int x) { return x * 2; }, 21);
+	int x = f.get();
+	assert(x == 42);
+
+	// a chain of continuations, with and without results
+	int side = 0;
+	auto g = libstra::async(tp, []() { return std::string("ab"); })
+				 .then([](std::string s) { return s + "c"; })
+				 .then([&side](std::string s) { side = (int)s.size(); })
+				 .then([&side]() { return side; });
+	tp.wait_for(g);
+	int y = g.get();
+	assert(y == 3);
+
+	// exceptions skip the continuations
+	bool called = false;
+	auto h = libstra::async(tp, []() -> int { throw std::runtime_error("e"); })
+				 .then([&called](int x) {
+					 called = true;
+					 return x;
+				 });
+	try {
+		h.get();
+		assert(false);
+	} catch (const std::runtime_error &) {
+	}
+	assert(!called);
+}
+
+void test3() {
+	// continuations on a promise run in the thread which sets the value
+	libstra::promise<int> p;
+	auto f = p.get_future().then([](int x) { return x + 1; });
+	p.set_value(1);
+	assert(f.ready());
+	int x = f.get();
+	assert(x == 2);
+	// or right away if the value is already set
+	libstra::promise<int> q;
+	q.set_value(5);
+	auto g = q.get_future().then([](int x) { return x - 1; });
+	assert(g.ready());
+	x = g.get();
+	assert(x == 4);
+}
+
+void test4() {
+	libstra::thread_pool tp(4);
+	std::vector<libstra::future<int>> v;
+	for (int i = 0; i < 10; ++i)
+		v.push_back(libstra::async(tp, [i]() { return i; }));
+	auto all = libstra::when_all(v.begin(), v.end()).then(
+		[](std::vector<libstra::future<int>> r) {
+			int sum = 0;
+			for (auto &f : r)
+				sum += f.get();
+			return sum;
+		});
+	int sum = all.get();
+	assert(sum == 45);
+
+	libstra::promise<int> never;
+	std::vector<libstra::future<int>> w;
+	w.push_back(never.get_future());
+	w.push_back(libstra::async(tp, []() { return 7; }));
+	auto any = libstra::when_any(w.begin(), w.end());
+	auto r = any.get();
+	assert(r.index == 1);
+	int x = r.futures[1].get();
+	assert(x == 7);
+	assert(!r.futures[0].ready());
+
+	std::vector<libstra::future<int>> none;
+	auto all_none = libstra::when_all(none.begin(), none.end()).get();
+	assert(all_none.empty());
+	auto any_none = libstra::when_any(none.begin(), none.end()).get();
+	assert(any_none.index == size_t(-1));
+}
+
+void test5() {
+	// the futures which get ready after the winner all notify the state
+	// concurrently, while the result is being consumed
+	constexpr int n = 32;
+	for (int round = 0; round < 200; ++round) {
+		std::vector<libstra::promise<int>> promises(n);
+		std::vector<libstra::future<int>> v;
+		for (auto &p : promises)
+			v.push_back(p.get_future());
+		auto any = libstra::when_any(v.begin(), v.end());
+		std::vector<std::thread> threads;
+		for (int i = 0; i < n; ++i) {
+			threads.emplace_back(
+				[&promises, i]() { promises[i].set_value(i); });
+		}
+		auto r = any.get();
+		assert(r.index < n);
+		int x = r.futures[r.index].get();
+		assert(x == int(r.index));
+		r.futures.clear();
+		for (auto &t : threads)
+			t.join();
+	}
+}
+
+void test6() {
+	// the tasks dropped by a pool break their futures, and the continuations
+	std::promise<void> gate;
+	std::thread release;
+	libstra::future<int> f, g;
+	{
+		libstra::thread_pool tp(1);
+		std::promise<void> started;
+		tp.post([&started, g = gate.get_future()]() {
+			started.set_value();
+			g.wait();
+		});
+		started.get_future().wait();
+		f = libstra::async(tp, []() { return 1; });
+		g = libstra::async(tp, []() { return 2; }).then([](int x) {
+			return x + 1;
+		});
+		// the pool is stopped by then, so the thread doesn't run the others
+		release = std::thread([&gate]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			gate.set_value();
+		});
+	}
+	release.join();
+	for (auto *fut : { &f, &g }) {
+		assert(fut->ready());
+		try {
+			fut->get();
+			assert(false);
+		} catch (const libstra::broken_promise &) {
+		}
+	}
+}
+
+void test7() {
+	// a ready future doesn't use its pool anymore
+	libstra::future<int> f;
+	{
+		libstra::thread_pool tp(1);
+		f = libstra::async(tp, []() { return 4; });
+		f.wait();
+	}
+	auto g = std::move(f).then([](int x) { return x * 2; });
+	assert(g.ready());
+	int x = g.get();
+	assert(x == 8);
+}
+
+int main() {
+	test1();
+	test2();
+	test3();
+	test4();
+	test5();
+	test6();
+	test7();
+}
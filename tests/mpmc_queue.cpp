@@ -0,0 +1,61 @@
+#include <libstra/mpmc_queue.hpp>
+#include <cassert>
+#include <memory>
+#include <thread>
+#include <vector>
+
+void test1() {
+	libstra::mpmc_queue<std::unique_ptr<int>> q(3);
+	assert(q.capacity() == 4);
+	std::unique_ptr<int> p;
+	assert(!q.try_pop(p));
+	for (int i = 0; i < 4; ++i)
+		assert(q.try_push(std::make_unique<int>(i)));
+	auto extra = std::make_unique<int>(4);
+	assert(!q.try_push(std::move(extra)));
+	assert(extra && q.size_approx() == 4);
+	for (int i = 0; i < 4; ++i) {
+		assert(q.try_pop(p));
+		assert(*p == i);
+	}
+	assert(!q.try_pop(p));
+	// the elements left in the queue are destroyed with it
+	assert(q.try_push(std::move(extra)));
+}
+
+void test2() {
+	constexpr size_t producers = 4, consumers = 4, n = 10000;
+	libstra::mpmc_queue<size_t> q(64);
+	std::atomic<size_t> sum{ 0 }, popped{ 0 };
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < producers; ++i) {
+		threads.emplace_back([&q]() {
+			for (size_t j = 1; j <= n; ++j) {
+				size_t x = j;
+				while (!q.try_push(std::move(x)))
+					std::this_thread::yield();
+			}
+		});
+	}
+	for (size_t i = 0; i < consumers; ++i) {
+		threads.emplace_back([&]() {
+			size_t x;
+			while (popped.load() < producers * n) {
+				if (!q.try_pop(x)) {
+					std::this_thread::yield();
+					continue;
+				}
+				sum += x;
+				++popped;
+			}
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+	assert(sum == producers * n * (n + 1) / 2);
+}
+
+int main() {
+	test1();
+	test2();
+}
@@ -0,0 +1,67 @@
+#include <libstra/parallel.hpp>
+#include <cassert>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+void test1() {
+	libstra::thread_pool tp(4);
+	std::vector<int> v(100000);
+	libstra::parallel_for(tp, size_t(0), v.size(), 64,
+						  [&v](size_t i) { v[i] = int(i); });
+	for (size_t i = 0; i < v.size(); ++i)
+		assert(v[i] == int(i));
+	// negative indices, and a range smaller than the grain
+	std::atomic<int> sum{ 0 };
+	libstra::parallel_for(tp, -5, 5, 16, [&sum](int i) { sum += i; });
+	assert(sum == -5);
+	libstra::parallel_for(tp, 5, 5, 1, [](int) { assert(false); });
+}
+
+void test2() {
+	libstra::thread_pool tp(4);
+	std::vector<long long> v(1000000);
+	std::iota(v.begin(), v.end(), 1);
+	auto add = [](long long a, long long b) { return a + b; };
+	long long r =
+		libstra::parallel_reduce(tp, v.begin(), v.end(), 1024, 10LL, add);
+	assert(r == 10 + 1000000LL * 1000001 / 2);
+	r = libstra::parallel_reduce(tp, v.begin(), v.begin(), 1, 10LL, add);
+	assert(r == 10);
+}
+
+void test3() {
+	libstra::thread_pool tp(2);
+	std::atomic<int> count{ 0 };
+	try {
+		libstra::parallel_for(tp, 0, 10000, 1, [&count](int i) {
+			++count;
+			if (i == 100) throw std::runtime_error("stop");
+		});
+		assert(false);
+	} catch (const std::runtime_error &) {
+	}
+	// the remaining chunks were cancelled
+	assert(count < 10000);
+	// the pool is still usable
+	libstra::parallel_for(tp, 0, 100, 1, [&count](int) { ++count; });
+}
+
+void test4() {
+	// a loop run from one of the pool's threads
+	libstra::thread_pool tp(2);
+	auto r = tp.enqueue_task<int>([&tp]() {
+		std::vector<int> v(1000, 1);
+		return libstra::parallel_reduce(tp, v.begin(), v.end(), 8, 0,
+										[](int a, int b) { return a + b; });
+	});
+	int x = r.get();
+	assert(x == 1000);
+}
+
+int main() {
+	test1();
+	test2();
+	test3();
+	test4();
+}
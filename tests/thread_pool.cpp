@@ -2,6 +2,10 @@
 #include <iostream>
 #include <cassert>
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 struct A {
 	int _val = 0;
@@ -89,9 +93,279 @@ void test4() {
 	tp.wait();
 	std::cout << B::copies << ' ' << B::moves << '\n';
 }
+void test5() {
+	libstra::thread_pool tp(2);
+	auto r = tp.enqueue_task<int>([](int x) noexcept { return x * 2; }, 21);
+	auto x = r.get();
+	assert(x == 42);
+}
+struct Counter {
+	int n = 0;
+	int add(int x) { return n += x; }
+};
+
+void test6() {
+	libstra::thread_pool tp(1);
+	Counter c;
+	auto r = tp.enqueue_task<int>(&Counter::add, &c, 2);
+	auto x = r.get();
+	assert(x == 2 && c.n == 2);
+}
+
+// Tasks submitted concurrently from several threads, to a pool backed by a
+// lock-free queue small enough to overflow
+void test8() {
+	libstra::thread_pool_options opt;
+	opt.lock_free_capacity = 16;
+	libstra::thread_pool tp(4, opt);
+	std::atomic<int> count{ 0 };
+	std::vector<std::thread> producers;
+	for (int i = 0; i < 4; ++i) {
+		producers.emplace_back([&]() {
+			for (int j = 0; j < 1000; ++j)
+				(void)tp.enqueue_task<void>([&count]() { ++count; });
+		});
+	}
+	for (auto &t : producers)
+		t.join();
+	tp.wait();
+	assert(count == 4000);
+	auto r = tp.enqueue_task<int>([]() { return 1; });
+	auto x = r.get();
+	assert(x == 1);
+}
+
+void test9() {
+	libstra::thread_pool tp(2);
+	tp.stop();
+	tp.restart();
+	auto r = tp.enqueue_task<int>([]() { return 2; });
+	auto x = r.get();
+	assert(x == 2);
+}
+
+// Each task forks two smaller ones from a worker, until n is 0
+void fork_tasks(libstra::thread_pool &tp, std::atomic<int> &count, int n) {
+	++count;
+	if (!n) return;
+	for (int i = 0; i < 2; ++i)
+		(void)tp.enqueue_task<void>(&fork_tasks, std::ref(tp), std::ref(count),
+									n - 1);
+}
+
+void test10() {
+	libstra::thread_pool_options opt;
+	opt.work_stealing = true;
+	libstra::thread_pool tp(4, opt);
+	std::atomic<int> count{ 0 };
+	(void)tp.enqueue_task<void>(&fork_tasks, std::ref(tp), std::ref(count), 12);
+	tp.wait();
+	assert(count == (1 << 13) - 1);
+	auto r = tp.enqueue_task<int>([]() { return 3; });
+	auto x = r.get();
+	assert(x == 3);
+}
+
+void test11() {
+	std::atomic<int> count{ 0 }, errors{ 0 };
+	libstra::thread_pool_options opt;
+	opt.exception_handler = [&errors](std::exception_ptr e) {
+		try {
+			std::rethrow_exception(e);
+		} catch (int x) {
+			errors += x;
+		}
+	};
+	libstra::thread_pool tp(2, opt);
+	for (int i = 0; i < 100; ++i) {
+		tp.post([&count]() noexcept { ++count; });
+		tp.post(
+			[&count](int x) {
+				if (x % 2) throw x;
+				count += x;
+			},
+			i);
+	}
+	tp.wait();
+	assert(count == 100 + 2450);
+	assert(errors == 2500);
+}
+
+void test12() {
+	libstra::thread_pool tp(4);
+	std::atomic<int> count{ 0 };
+	std::vector<libstra::unique_function<void()>> tasks;
+	for (int i = 1; i <= 1000; ++i)
+		tasks.emplace_back([&count, i]() { count += i; });
+	tp.enqueue_bulk(std::make_move_iterator(tasks.begin()),
+					std::make_move_iterator(tasks.end()));
+	tp.wait();
+	assert(count == 500500);
+	// the elements are copied from a plain iterator
+	auto inc = [&count]() noexcept { ++count; };
+	std::vector<decltype(inc)> incs(10, inc);
+	tp.enqueue_bulk(incs.begin(), incs.end());
+	tp.enqueue_bulk(incs.begin(), incs.begin());
+	tp.wait();
+	assert(count == 500510);
+}
+
+void test13() {
+	// each thread waits on a task which can only run on the pool
+	libstra::thread_pool tp(2);
+	std::vector<std::future<int>> results;
+	for (int i = 0; i < 4; ++i) {
+		results.push_back(tp.enqueue_task<int>([&tp, i]() {
+			auto inner = tp.enqueue_task<int>([i]() { return i; });
+			tp.wait_for(inner);
+			return inner.get() + 1;
+		}));
+	}
+	for (int i = 0; i < 4; ++i) {
+		tp.wait_for(results[i]);
+		auto x = results[i].get();
+		assert(x == i + 1);
+	}
+	// a nested wait returns once the other tasks are done
+	std::atomic<int> count{ 0 };
+	auto r = tp.enqueue_task<int>([&]() {
+		for (int i = 0; i < 100; ++i)
+			tp.post([&count]() noexcept { ++count; });
+		tp.wait();
+		return count.load();
+	});
+	auto x = r.get();
+	assert(x == 100);
+	// the same, from a task run by a thread which isn't one of the pool's
+	std::atomic<int> inner{ 0 };
+	tp.post([&]() {
+		for (int i = 0; i < 10; ++i)
+			tp.post([&inner]() noexcept { ++inner; });
+		tp.wait();
+		inner += 100;
+	});
+	tp.wait();
+	assert(inner == 110);
+	tp.wait();
+	tp.stop();
+}
+
+void test14() {
+	using libstra::task_priority;
+	libstra::thread_pool_options opt;
+	opt.starvation_limit = 0;
+	libstra::thread_pool tp(1, opt);
+	// keep the only thread busy while the tasks are queued
+	std::promise<void> gate;
+	auto blocked = gate.get_future().share();
+	tp.post([blocked]() { blocked.wait(); });
+	while (tp.depth(task_priority::normal))
+		std::this_thread::yield();
+
+	std::vector<int> order;
+	std::promise<void> done;
+	tp.post(task_priority::background, [&order, &done]() {
+		order.push_back(3);
+		done.set_value();
+	});
+	tp.post([&order]() { order.push_back(2); });
+	auto r = tp.enqueue_task<int>(task_priority::high, [&order]() {
+		order.push_back(1);
+		return 1;
+	});
+	assert(tp.depth(task_priority::high) == 1);
+	assert(tp.depth(task_priority::normal) == 1);
+	assert(tp.depth(task_priority::background) == 1);
+	gate.set_value();
+	// not tp.wait(), as this thread would run some of the tasks
+	done.get_future().wait();
+	auto x = r.get();
+	assert(x == 1);
+	assert((order == std::vector<int>{ 1, 2, 3 }));
+	assert(!tp.depth(task_priority::high) && !tp.depth(task_priority::normal));
+}
+
+void test15() {
+	using libstra::task_priority;
+	libstra::thread_pool_options opt;
+	opt.starvation_limit = 4;
+	libstra::thread_pool tp(1, opt);
+	std::promise<void> gate;
+	auto blocked = gate.get_future().share();
+	tp.post([blocked]() { blocked.wait(); });
+	while (tp.depth(task_priority::normal))
+		std::this_thread::yield();
+
+	// the background task runs before all the high priority ones are done
+	std::atomic<int> high_done{ 0 }, seen{ -1 };
+	for (int i = 0; i < 100; ++i)
+		tp.post(task_priority::high, [&high_done]() { ++high_done; });
+	tp.post(task_priority::background,
+			[&high_done, &seen]() { seen = high_done.load(); });
+	gate.set_value();
+	tp.wait();
+	assert(high_done == 100 && seen >= 0 && seen < 100);
+}
+
+#if LIBSTRA_HAS_COROUTINES
+// A coroutine which starts eagerly, and whose frame is destroyed at the end
+struct detached {
+	struct promise_type {
+		detached get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+detached resume_on(libstra::thread_pool &tp, std::promise<std::thread::id> &p) {
+	co_await tp.schedule();
+	p.set_value(std::this_thread::get_id());
+}
+
+void test7() {
+	libstra::thread_pool tp(2);
+	std::promise<std::thread::id> p;
+	resume_on(tp, p);
+	// not tp.wait(), which could resume the coroutine on this thread
+	auto x = p.get_future().get();
+	assert(x != std::this_thread::get_id());
+}
+#endif
+
+void test16() {
+	// a future made ready outside of the pool still ends the wait
+	libstra::thread_pool tp(1);
+	std::promise<int> p;
+	auto f = p.get_future();
+	std::thread t([&p]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		p.set_value(3);
+	});
+	tp.wait_for(f);
+	int x = f.get();
+	assert(x == 3);
+	t.join();
+}
+
 int main() {
 	test1();
 	test2();
 	test3();
 	test4();
+	test5();
+	test6();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+#if LIBSTRA_HAS_COROUTINES
+	test7();
+#endif
 }
@@ -1,7 +1,62 @@
 #include <libstra/unique_function.hpp>
+#include <libstra/function_vector.hpp>
 #include <iostream>
 #include <cassert>
 #include <functional>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+static size_t allocations = 0;
+
+void *operator new(size_t n) {
+	++allocations;
+	if (void *p = std::malloc(n)) return p;
+	throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
+#if __cpp_aligned_new
+// MSVC doesn't have std::aligned_alloc, and needs its own function to free
+// the memory
+static void *aligned_malloc(size_t n, size_t a) {
+#ifdef _MSC_VER
+	return _aligned_malloc(n, a);
+#else
+	return std::aligned_alloc(a, (n + a - 1) / a * a);
+#endif
+}
+static void aligned_free(void *p) {
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void *operator new(size_t n, std::align_val_t al) {
+	++allocations;
+	if (void *p = aligned_malloc(n, (size_t)al)) return p;
+	throw std::bad_alloc{};
+}
+void operator delete(void *p, std::align_val_t) noexcept {
+	aligned_free(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+	aligned_free(p);
+}
+#endif
 
 struct F {
 	bool _moved = false;
@@ -20,45 +75,99 @@ int bar(int x) {
 	return x;
 }
 
+constexpr libstra::function_ref<int()> constexpr_ref = foo;
+static_assert(constexpr_ref && !libstra::function_ref<int()>{},
+			  "constexpr function_ref test failed");
+static_assert(sizeof(libstra::function_ref<int()>) == 2 * sizeof(void *),
+			  "function_ref size test failed");
+static_assert(std::is_trivially_copyable<libstra::function_ref<int()>>::value,
+			  "function_ref triviality test failed");
+
 void function_ref_tests() {
 	using libstra::function_ref;
 	function_ref<int()> f1;
-	assert(f1.target_type() == typeid(void));
+	assert(!f1.target<int()>());
 	f1 = foo;
-	assert(f1.target_type() == typeid(foo));
+	assert(f1.target<int()>() == foo);
+	assert(!f1.target<int(int)>());
 	auto f2 = f1;
-	assert(f2.target_type() == typeid(foo));
+	assert(f2.target<int()>() == foo);
 	assert(f2() == 2 && f1() == 2);
+	assert(constexpr_ref() == 2);
 
 	f1 = F{};
 	assert(f1() == F{}());
 	f2 = [x = F{}]() { return 42; };
 	assert(f2() == 42);
+
+	const F cf{};
+	function_ref<int()> f3 = cf;
+	assert(f3.target<F>() == &cf);
+	assert(f3.target<const F>() == &cf);
+	assert(!f3.target<int()>());
+	// the same code, for different types
+	struct G1 {
+		int operator()() const { return 3; }
+	} g1;
+	struct G2 {
+		int operator()() const { return 3; }
+	} g2;
+	function_ref<int()> r1 = g1, r2 = g2;
+	assert(r1.target<G1>() == &g1 && !r1.target<G2>());
+	assert(r2.target<G2>() == &g2 && !r2.target<G1>());
+#if LIBSTRA_HAS_RTTI
+	assert(f3.target_type() == typeid(F));
+	assert(r1.target_type() == typeid(G1));
+	assert(constexpr_ref.target_type() == typeid(int()));
+	assert(function_ref<int()>{}.target_type() == typeid(void));
+#endif
+	int (*null)() = nullptr;
+	assert(!function_ref<int()>(null));
 }
 void unique_function_tests() {
 	using libstra::function_ref;
 	using libstra::unique_function;
 	unique_function<int()> f1;
+#if LIBSTRA_HAS_RTTI
 	assert(f1.target_type() == typeid(void));
+#endif
 	f1 = foo;
+#if LIBSTRA_HAS_RTTI
 	assert(f1.target_type() == typeid(foo));
+#endif
+	assert(f1.target<int()>() == foo);
 	auto f2 = std::move(f1);
+#if LIBSTRA_HAS_RTTI
 	assert(f1.target_type() == typeid(void));
+#endif
 	assert(!f1);
+	assert(!f1.target<int()>());
+#if LIBSTRA_HAS_RTTI
 	assert(f2.target_type() == typeid(foo));
+#endif
+	assert(f2.target<int()>() == foo);
 	assert(f2() == foo());
+	assert(f2.invoke_unchecked() == foo());
 	f1 = std::move(f2);
+#if LIBSTRA_HAS_RTTI
 	assert(f2.target_type() == typeid(void));
+#endif
 	assert(!f2);
+	try {
+		f2();
+		assert(0);
+	} catch (const libstra::invalid_function_access &) {
+	}
 
 	f1 = F{};
 	assert(f1() == F{}());
+	assert(f1.target<F>() && !f1.target<int()>());
 	f2 = [x = F{}]() { return 42; };
 	assert(f2() == 42);
 
 	auto ref = f1.get_ref<F>();
 	assert(ref);
-	assert(ref.target_type() == typeid(F));
+	assert(ref.target<F>() == f1.target<F>());
 	assert(ref() == F{}());
 }
 void bind_tests() {
@@ -67,8 +176,391 @@ void bind_tests() {
 	assert(b() == 1);
 }
 
+void inline_buffer_tests() {
+	using libstra::basic_unique_function;
+	using libstra::unique_function;
+	void *a = nullptr, *b = nullptr, *c = nullptr;
+	auto l = [a, b, c]() { return a == b && b == c; };
+	size_t n = allocations;
+	{
+		unique_function<bool()> f = [a, b]() { return a == b; };
+		assert(f());
+		assert(allocations == n);
+		unique_function<bool()> g = l;
+		assert(g());
+		assert(allocations == n + 1);
+	}
+	n = allocations;
+	{
+		basic_unique_function<bool(), 3 * sizeof(void *)> f = l;
+		assert(f());
+		assert(allocations == n);
+		basic_unique_function<bool(), 3 * sizeof(void *)> g = std::move(f);
+		assert(!f && g());
+		assert(g.target<decltype(l)>());
+	}
+	struct alignas(32) Over {
+		int operator()() const { return 1; }
+	};
+	n = allocations;
+	{
+		basic_unique_function<int(), 32> f = Over{};
+		assert(f() == 1);
+		assert(allocations == n + 1);
+		basic_unique_function<int(), 32, 32> g = Over{};
+		assert(g() == 1);
+		assert(allocations == n + 1);
+	}
+	static_assert(sizeof(basic_unique_function<void(), 64>) >
+					  sizeof(unique_function<void()>),
+				  "basic_unique_function size test failed");
+	static_assert(sizeof(unique_function<void()>) == 3 * sizeof(void *),
+				  "unique_function size test failed");
+}
+
+struct Relocatable {
+	static int moves;
+	int _val = 7;
+	Relocatable() = default;
+	Relocatable(Relocatable &&other) noexcept : _val(other._val) { ++moves; }
+	int operator()() const { return _val; }
+};
+int Relocatable::moves = 0;
+
+namespace libstra {
+	template <>
+	struct is_trivially_relocatable<Relocatable> : std::true_type {};
+} // namespace libstra
+
+void relocation_tests() {
+	using libstra::basic_unique_function;
+	using Func = basic_unique_function<std::string(), 64>;
+	std::string str = "a string long enough to not be stored in place, "
+					  "in any implementation";
+	std::string small = "small";
+	Func f = [small]() { return small; };
+	Func g = [str]() { return str; };
+	Func h = std::move(f);
+	assert(!f && h() == small);
+	h.swap(g);
+	assert(h() == str && g() == small);
+	f = std::move(h);
+	assert(!h && f() == str);
+
+	libstra::unique_function<int()> r = Relocatable{};
+	int moves = Relocatable::moves;
+	auto r2 = std::move(r);
+	assert(r2() == 7);
+	assert(Relocatable::moves == moves);
+}
+
+template <class T>
+struct counting_allocator {
+	using value_type = T;
+	size_t *_count;
+	counting_allocator(size_t *count) : _count(count) {}
+	template <class U>
+	counting_allocator(const counting_allocator<U> &other) :
+		_count(other._count) {}
+	T *allocate(size_t n) {
+		++*_count;
+		return std::allocator<T>{}.allocate(n);
+	}
+	void deallocate(T *p, size_t n) {
+		--*_count;
+		std::allocator<T>{}.deallocate(p, n);
+	}
+};
+
+void allocator_tests() {
+	using libstra::unique_function;
+	size_t count = 0;
+	counting_allocator<char> alloc(&count);
+	std::string str = "a string long enough to not be stored in place, "
+					  "in any implementation";
+	{
+		unique_function<int()> f(std::allocator_arg, alloc, foo);
+		assert(f() == foo() && count == 0);
+		unique_function<std::string()> g(std::allocator_arg, alloc,
+										 [str]() { return str; });
+		assert(count == 1);
+		auto h = std::move(g);
+		assert(h() == str);
+		assert(h);
+	}
+	assert(count == 0);
+#if __cplusplus >= 201703L
+	char buf[256];
+	std::pmr::monotonic_buffer_resource res(buf, sizeof(buf),
+											std::pmr::null_memory_resource());
+	auto l = [str]() { return str.size(); };
+	size_t n = allocations;
+	{
+		unique_function<size_t()> f(std::allocator_arg,
+									std::pmr::polymorphic_allocator<char>(&res),
+									std::move(l));
+		assert(f() == str.size());
+	}
+	assert(allocations == n);
+#endif
+}
+
+void parameter_tests() {
+	using libstra::function_ref;
+	using libstra::unique_function;
+	int x = 5;
+	double d = 0.5;
+	std::string str = "str";
+	unique_function<int(int)> f = bar;
+	assert(f(x) == 5 && f(3) == 3);
+	function_ref<int(int)> r = bar;
+	assert(r(x) == 5);
+	unique_function<double(double, int &, std::string)> g =
+		[](double d, int &i, std::string s) {
+			++i;
+			return d + s.size();
+		};
+	assert(g(d, x, std::move(str)) == 3.5 && x == 6);
+	function_ref<double(double, int &, std::string)> gr = g;
+	assert(gr(d, x, "ab") == 2.5 && x == 7);
+}
+
+void qualifier_tests() {
+	using libstra::unique_function;
+	auto mut = [x = 0]() mutable { return ++x; };
+	auto cst = [x = 1]() { return x; };
+	static_assert(
+		!std::is_constructible<unique_function<int() const>, decltype(mut)>::
+			value,
+		"const unique_function test failed");
+	const unique_function<int() const> c = cst;
+	assert(c() == 1 && c.invoke_unchecked() == 1);
+	unique_function<int()> m = mut;
+	assert(m() == 1 && m() == 2);
+	static_assert(
+		std::is_same<libstra::invoke_result_t<unique_function<int() const>>,
+					 int>::value,
+		"invoke_result test failed");
+#if __cpp_noexcept_function_type
+	auto nt = [](int x) noexcept { return x; };
+	static_assert(!std::is_constructible<unique_function<int(int) noexcept>,
+										 decltype(bar)>::value,
+				  "noexcept unique_function test failed");
+	unique_function<int(int) noexcept> n = nt;
+	static_assert(noexcept(n(1)), "noexcept unique_function test failed");
+	assert(n(3) == 3);
+	const unique_function<int(int) const noexcept> cn = nt;
+	assert(cn(4) == 4);
+#endif
+}
+
+void inplace_function_tests() {
+	using libstra::inplace_function;
+	static_assert(sizeof(inplace_function<void(), 32>) == 32 + sizeof(void *),
+				  "inplace_function size test failed");
+	std::string str = "a string long enough to not be stored in place, "
+					  "in any implementation";
+	size_t n = allocations;
+	{
+		void *a = nullptr, *b = nullptr, *c = nullptr;
+		inplace_function<bool(), 3 * sizeof(void *)> f = [a, b, c]() {
+			return a == b && b == c;
+		};
+		assert(f());
+		inplace_function<int(int)> g = bar;
+		assert(g(1) == 1);
+		auto h = std::move(g);
+		assert(!g && h(2) == 2);
+		g = [a](int x) { return x + (a != nullptr); };
+		g.swap(h);
+		assert(g(3) == 3 && g.target<int(int)>() == bar && h(3) == 3);
+		const inplace_function<size_t() const, sizeof(std::string)> s =
+			[&str]() { return str.size(); };
+		assert(s() == str.size());
+	}
+	assert(allocations == n);
+	inplace_function<std::string(), sizeof(std::string)> f =
+		[s = std::string("str")]() { return s; };
+	auto g = std::move(f);
+	assert(g() == "str");
+}
+
+void copyable_function_tests() {
+	using libstra::copyable_function;
+	copyable_function<int(int)> f = bar;
+	auto g = f;
+	assert(f(1) == 1 && g(2) == 2);
+	int count = 0;
+	// small targets are copied by value
+	f = [count](int x) mutable { return count += x; };
+	g = f;
+	assert(f(1) == 1 && f(1) == 2 && g(1) == 1);
+
+	// large targets are deep copied by default
+	std::string str = "a string long enough to not be stored in place, "
+					  "in any implementation";
+	copyable_function<size_t()> h = [str]() { return str.size(); };
+	size_t n = allocations;
+	auto h2 = h;
+	assert(allocations > n);
+	assert(h2() == str.size());
+
+	// or shared between the copies
+	copyable_function<size_t() const> s{ libstra::shared_target_t{},
+										  [str]() { return str.size(); } };
+	n = allocations;
+	std::vector<copyable_function<size_t() const>> subscribers(8, s);
+	assert(allocations == n + 1); // only the vector itself
+	for (const auto &sub : subscribers)
+		assert(sub() == str.size());
+	s = copyable_function<size_t() const>{};
+	subscribers.resize(1);
+	assert(subscribers[0]() == str.size());
+	auto moved = std::move(subscribers[0]);
+	assert(!subscribers[0] && moved() == str.size());
+
+	// a shared target is only accessible as const
+	struct Len {
+		std::string str;
+		size_t operator()() const { return str.size(); }
+	};
+	copyable_function<size_t() const> l{ libstra::shared_target_t{},
+										  Len{ str } },
+		d = Len{ str };
+	const auto &cl = l;
+	assert(!l.target<Len>() && cl.target<Len>()->str == str);
+	assert(d.target<Len>());
+}
+
+struct Msg {
+	int value;
+};
+struct Error {
+	int code;
+};
+struct Handler {
+	int *last;
+	void operator()(const Msg &m) { *last = m.value; }
+	void operator()(Error e) { *last = -e.code; }
+	int operator()(int x) const { return x + *last; }
+};
+
+void overload_tests() {
+	int last = 0;
+	libstra::unique_function<void(const Msg &), void(Error), int(int) const>
+		h = Handler{ &last };
+	static_assert(sizeof(h) == sizeof(libstra::unique_function<void()>),
+				  "overloaded unique_function size test failed");
+	h(Msg{ 3 });
+	assert(last == 3);
+	h(Error{ 2 });
+	assert(last == -2);
+	const auto &c = h;
+	assert(c(5) == 3);
+	assert(h.target<Handler>() && h.target<Handler>()->last == &last);
+	auto h2 = std::move(h);
+	assert(!h);
+	h2.invoke_unchecked(Msg{ 7 });
+	assert(last == 7);
+
+	libstra::basic_copyable_function<
+		libstra::overloads<void(const Msg &), void(Error)>>
+		f = Handler{ &last }, g = f;
+	g(Error{ 1 });
+	assert(last == -1);
+}
+
+#if LIBSTRA_HAS_COROUTINES
+struct lazy {
+	struct promise_type {
+		int *out;
+		promise_type(int *o) : out(o) {}
+		lazy get_return_object() noexcept {
+			return { std::coroutine_handle<promise_type>::from_promise(*this) };
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() noexcept { *out = 1; }
+		void unhandled_exception() noexcept {}
+	};
+	std::coroutine_handle<promise_type> h;
+};
+
+lazy set_one(int *) {
+	co_return;
+}
+
+void coroutine_tests() {
+	int x = 0;
+	lazy c = set_one(&x);
+	size_t n = allocations;
+	libstra::basic_unique_function<void() noexcept> f = c.h;
+	assert(allocations == n);
+	assert(f.target<std::coroutine_handle<lazy::promise_type>>());
+	f();
+	assert(x == 1 && c.h.done());
+	c.h.destroy();
+}
+#endif
+
+#if LIBSTRA_FUNCTION_STATS
+static const char *last_heap_type = nullptr;
+static size_t last_heap_bytes = 0;
+
+void stats_tests() {
+	libstra::function_stats &stats = libstra::get_function_stats();
+	stats.reset();
+	stats.heap_hook = [](const char *name, size_t bytes) {
+		last_heap_type = name;
+		last_heap_bytes = bytes;
+	};
+	struct Large {
+		char buf[64];
+		void operator()() {}
+	};
+	libstra::unique_function<void()> f = []() {}, g = Large{};
+	libstra::inplace_function<void()> h = []() {};
+	assert(stats.inline_count == 2);
+	assert(stats.heap_count == 1);
+	assert(stats.heap_bytes == sizeof(Large));
+	assert(last_heap_bytes == sizeof(Large));
+#if LIBSTRA_HAS_RTTI
+	assert(last_heap_type && last_heap_type == typeid(Large).name());
+#else
+	assert(!last_heap_type);
+#endif
+	// copies and the objects of a function_vector are counted as well
+	stats.reset();
+	libstra::copyable_function<void()> c1 = []() {}, c2 = Large{};
+	auto c3 = c1, c4 = c2;
+	assert(stats.inline_count == 2);
+	assert(stats.heap_count == 2);
+	libstra::function_vector<void()> v;
+	v.push_back([]() {});
+	v.push_back(Large{});
+	assert(stats.inline_count == 4);
+	stats.heap_hook = nullptr;
+	stats.reset();
+	assert(!stats.inline_count && !stats.heap_count && !stats.heap_bytes);
+}
+#endif
+
 int main(int argc, char const *argv[]) {
 	function_ref_tests();
 	unique_function_tests();
 	bind_tests();
+	inline_buffer_tests();
+	relocation_tests();
+	allocator_tests();
+	parameter_tests();
+	qualifier_tests();
+	inplace_function_tests();
+	copyable_function_tests();
+	overload_tests();
+#if LIBSTRA_HAS_COROUTINES
+	coroutine_tests();
+#endif
+#if LIBSTRA_FUNCTION_STATS
+	stats_tests();
+#endif
 }
\ No newline at end of file
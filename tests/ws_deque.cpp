@@ -0,0 +1,63 @@
+#include <libstra/ws_deque.hpp>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+void test1() {
+	libstra::ws_deque<int> d(2);
+	int x;
+	assert(!d.pop(x) && !d.steal(x));
+	// the deque grows past its initial capacity
+	for (int i = 0; i < 100; ++i)
+		d.push(i);
+	assert(d.size_approx() == 100);
+	// the owner pops the last element, thieves steal the first one
+	assert(d.pop(x) && x == 99);
+	assert(d.steal(x) && x == 0);
+	assert(d.steal(x) && x == 1);
+	assert(d.pop(x) && x == 98);
+	assert(d.size_approx() == 96);
+	while (d.pop(x))
+		;
+	assert(x == 2 && !d.steal(x));
+}
+
+void test2() {
+	constexpr size_t thieves = 4, n = 100000;
+	libstra::ws_deque<size_t> d;
+	std::atomic<size_t> sum{ 0 }, taken{ 0 };
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < thieves; ++i) {
+		threads.emplace_back([&]() {
+			size_t x, local = 0;
+			while (taken.load() < n) {
+				if (!d.steal(x)) continue;
+				local += x;
+				++taken;
+			}
+			sum += local;
+		});
+	}
+	size_t x, local = 0;
+	for (size_t i = 1; i <= n; ++i) {
+		d.push(i);
+		// pop every other element, so that the owner races with the thieves
+		if (i % 2 && d.pop(x)) {
+			local += x;
+			++taken;
+		}
+	}
+	while (d.pop(x)) {
+		local += x;
+		++taken;
+	}
+	sum += local;
+	for (auto &t : threads)
+		t.join();
+	assert(sum == n * (n + 1) / 2);
+}
+
+int main() {
+	test1();
+	test2();
+}